@@ -0,0 +1,54 @@
+#ifndef LAB0_BACKEND_H
+#define LAB0_BACKEND_H
+
+/* Element stores behind the queues which do not link their elements into a
+ * list. A store only keeps pointers to elements in order: queue.c allocates
+ * and releases the elements and keeps the queue length, while the store
+ * allocates whatever memory it needs for the pointers itself.
+ */
+
+#include <stdbool.h>
+
+#include "queue.h"
+
+/**
+ * q_store_ops - Operations of an element store
+ * @create: make an empty store, NULL if no memory is left
+ * @destroy: free a store, without touching the elements it points to
+ * @reserve: make room for @n elements in all, so that refill() with at most
+ *           @n elements does not allocate; false if no memory is left
+ * @push: add @e at the tail if @tail is set, at the head otherwise; false if
+ *        no memory is left
+ * @pop: remove the element at the tail or the head, NULL if there is none
+ * @at: return the element at position @k, which must be in range
+ * @erase: remove and return the element at position @k, which must be in
+ *         range
+ * @seek: point @it at position @k, which may equal the number of elements
+ * @next: return the element @it points at and advance it, NULL past the tail
+ * @refill: replace the contents with the @n elements linked through @head, in
+ *          order, reusing the memory of the store
+ * @view: return the elements as one array, in order, which the store keeps
+ *        them in and which may be rearranged in place; NULL if the store
+ *        does not keep them contiguous
+ */
+typedef struct q_store_ops {
+    void *(*create)(void);
+    void (*destroy)(void *store);
+    bool (*reserve)(void *store, int n);
+    bool (*push)(void *store, element_t *e, bool tail);
+    element_t *(*pop)(void *store, bool tail);
+    element_t *(*at)(void *store, int k);
+    element_t *(*erase)(void *store, int k);
+    void (*seek)(void *store, q_iter_t *it, int k);
+    element_t *(*next)(void *store, q_iter_t *it);
+    void (*refill)(void *store, struct list_head *head, int n);
+    element_t **(*view)(void *store);
+} q_store_ops_t;
+
+/* Unrolled linked list, see unrolled.c */
+extern const q_store_ops_t unrolled_ops;
+
+/* Ring buffer deque, see ring.c */
+extern const q_store_ops_t ring_ops;
+
+#endif /* LAB0_BACKEND_H */
@@ -1,11 +1,18 @@
 /* Test support code */
 
+/* dladdr() is a GNU extension on Linux */
+#if defined(__linux__) || defined(__GNU__)
+#define _GNU_SOURCE
+#endif
+
+#include <dlfcn.h>
 #include <setjmp.h>
 #include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
 #include "report.h"
@@ -28,15 +35,54 @@
 /* Byte to fill newly malloced space with */
 #define FILLCHAR 0x55
 
+/* Slab pool parameters.
+ * Blocks up to POOL_MAX_BLOCK bytes, header and footer included, are carved
+ * out of POOL_PAGE_SIZE slabs in size classes of POOL_ALIGN bytes.
+ */
+#define POOL_ALIGN 16
+#define POOL_MAX_BLOCK 256
+#define POOL_CLASSES (POOL_MAX_BLOCK / POOL_ALIGN)
+#define POOL_PAGE_SIZE (64 * 1024)
+
+/* Arena parameters.
+ * Arena chunks are ARENA_CHUNK_SIZE bytes and aligned to their size, so that
+ * the chunk holding a block is found by masking the block address. Larger
+ * blocks get a dedicated chunk made of several such units.
+ */
+#define ARENA_CHUNK_SIZE (64 * 1024)
+#define ARENA_ALIGN 16
+
+/* Allocation profiler parameters.
+ * Up to PROFILE_SITES call sites are told apart, later ones are pooled in a
+ * catch-all entry. Sizes are binned in powers of two from 16 bytes up.
+ */
+#define PROFILE_SITES 1024
+#define PROFILE_CLASSES 8
+
+/* Guarded blocks end GUARD_ALIGN-aligned right before an inaccessible page */
+#define GUARD_ALIGN 8
+
+/* Byte filling the padding between a guarded payload and its guard page */
+#define GUARD_CANARY 0xbd
+
 /* Data structures used by our code */
 
+/* Where the memory of a block comes from */
+typedef enum {
+    BLOCK_MALLOC,
+    BLOCK_POOL,
+    BLOCK_ARENA,
+    BLOCK_GUARD,
+} block_source_t;
+
 /* Represent allocated blocks as doubly-linked list, with
  * next and prev pointers at beginning
  */
 typedef struct __block_element {
     struct __block_element *next, *prev;
     size_t payload_size;
-    size_t magic_header; /* Marker to see if block seems legitimate */
+    uint32_t source;       /* One of block_source_t, beside the 32-bit magic */
+    uint32_t magic_header; /* Marker to see if block seems legitimate */
     unsigned char payload[0];
     /* Also place magic number at tail of every block */
 } block_element_t;
@@ -44,9 +90,100 @@ typedef struct __block_element {
 static block_element_t *allocated = NULL;
 static size_t allocated_count = 0;
 
+/* Payload bytes of allocated blocks, now and at most so far */
+static size_t allocated_bytes = 0;
+static size_t allocated_peak = 0;
+
+/* Hash map from addresses to addresses.
+ * Open addressing with linear probing over a power-of-two table, which is
+ * doubled whenever it becomes half full, halved when it falls below an eighth
+ * full and freed once empty.
+ */
+#define ADDR_MIN_CAPACITY 1024
+
+typedef struct {
+    const void *key, *value;
+} addr_entry_t;
+
+typedef struct {
+    addr_entry_t *slots;
+    size_t capacity, used;
+} addr_map_t;
+
+/* Chunks of live arenas, used by cautious mode to check arena blocks */
+static addr_map_t arena_chunks;
+
+/* Call site of every block allocated while profiling */
+static addr_map_t profile_blocks;
+
+/* Slabs carved so far, chained through their first word */
+typedef struct __pool_page {
+    struct __pool_page *next;
+} pool_page_t;
+
+static pool_page_t *pool_pages = NULL;
+
+/* Free blocks of each size class, chained through their next pointer */
+static block_element_t *pool_free_list[POOL_CLASSES];
+
+typedef struct __arena_group arena_group_t;
+
+/* Arena chunks start with this header and are chained through next */
+typedef struct __arena_chunk {
+    struct __arena_chunk *next;
+    arena_group_t *group; /* Group the chunk currently belongs to */
+} arena_chunk_t;
+
+/* Memory of one or more arenas.
+ * Arenas handed out by test_arena_new() or test_arena_share() are handles on
+ * a group, which is freed along with its chunks once its last handle goes.
+ */
+struct __arena_group {
+    arena_chunk_t *chunks, *last;
+    unsigned char *cur, *end; /* Unused space of the current chunk */
+    size_t live;              /* Blocks not freed yet */
+    size_t bytes;             /* Payload bytes of those blocks */
+    test_arena_t *handles;    /* Arenas using the group */
+};
+
+struct test_arena {
+    arena_group_t *group;
+    struct test_arena *next; /* Next handle on the same group */
+};
+
+/* Allocation statistics of one call site */
+typedef struct {
+    const void *site;
+    size_t count, bytes;
+    size_t live_bytes, peak_bytes;
+    size_t hist[PROFILE_CLASSES];
+} profile_site_t;
+
+static profile_site_t profile_sites[PROFILE_SITES + 1];
+
+/* Scratch buffer handed out by test_scratch() */
+static void *scratch = NULL;
+static size_t scratch_size = 0;
+
 /* Percent probability of malloc failure */
 int fail_probability = 0;
 
+/* Serve small blocks from the slab pool */
+int pool_mode = 0;
+
+/* Let test_arena_new() hand out arenas */
+int arena_mode = 0;
+
+/* Put a guard page after every payload instead of a footer */
+int guard_mode = 0;
+
+/* Record allocations per call site */
+int profile_mode = 0;
+
+/* Fill one in scrub_interval payloads, never if zero */
+int scrub_interval = 1;
+static unsigned int scrub_count = 0;
+
 static bool cautious_mode = true;
 static bool noallocate_mode = false;
 static bool error_occurred = false;
@@ -74,6 +211,210 @@ static bool fail_allocation()
     return (weight < 0.01 * fail_probability);
 }
 
+/* Would extra more payload bytes exceed the memory limit? */
+static bool exceed_limit(size_t extra)
+{
+    size_t limit_bytes = (size_t) mblimit << 20;
+    if (mblimit <= 0 || allocated_bytes + extra <= limit_bytes)
+        return false;
+    report_event(MSG_WARN,
+                 "Exceeded memory limit of %d megabytes with %zu bytes",
+                 mblimit, allocated_bytes + extra);
+    return true;
+}
+
+/* Account for size payload bytes more, or fewer if shrink is set */
+static void account_bytes(size_t size, bool shrink)
+{
+    if (shrink) {
+        allocated_bytes -= size;
+        return;
+    }
+    allocated_bytes += size;
+    if (allocated_bytes > allocated_peak)
+        allocated_peak = allocated_bytes;
+}
+
+/* Should this payload be filled with FILLCHAR? */
+static bool scrub_payload()
+{
+    if (scrub_interval <= 0)
+        return false;
+    if (++scrub_count < (unsigned int) scrub_interval)
+        return false;
+    scrub_count = 0;
+    return true;
+}
+
+/* Home slot of key in m */
+static inline size_t addr_home(const addr_map_t *m, const void *key)
+{
+    uint64_t h = (uint64_t) (uintptr_t) key * 0x9e3779b97f4a7c15ULL;
+    return (size_t) (h ^ (h >> 32)) & (m->capacity - 1);
+}
+
+/* Return the slot holding key, or the empty slot where it would go */
+static size_t addr_find(const addr_map_t *m, const void *key)
+{
+    size_t i = addr_home(m, key);
+    while (m->slots[i].key && m->slots[i].key != key)
+        i = (i + 1) & (m->capacity - 1);
+    return i;
+}
+
+/* Return the entry of key, NULL if there is none */
+static addr_entry_t *addr_get(const addr_map_t *m, const void *key)
+{
+    if (!m->used)
+        return NULL;
+    addr_entry_t *e = &m->slots[addr_find(m, key)];
+    return e->key ? e : NULL;
+}
+
+/* Move the entries of m to a table of capacity slots */
+static bool addr_resize(addr_map_t *m, size_t capacity)
+{
+    addr_entry_t *slots = calloc(capacity, sizeof(addr_entry_t));
+    if (!slots)
+        return false;
+
+    addr_map_t old = *m;
+    m->slots = slots;
+    m->capacity = capacity;
+    for (size_t i = 0; i < old.capacity; i++) {
+        if (old.slots[i].key)
+            m->slots[addr_find(m, old.slots[i].key)] = old.slots[i];
+    }
+    free(old.slots);
+    return true;
+}
+
+/* Forget every entry of m */
+static void addr_clear(addr_map_t *m)
+{
+    free(m->slots);
+    m->slots = NULL;
+    m->capacity = 0;
+    m->used = 0;
+}
+
+/* Map key, which must not be mapped yet, to value */
+static bool addr_put(addr_map_t *m, const void *key, const void *value)
+{
+    if (2 * (m->used + 1) > m->capacity &&
+        !addr_resize(m, m->capacity ? 2 * m->capacity : ADDR_MIN_CAPACITY))
+        return false;
+
+    addr_entry_t *e = &m->slots[addr_find(m, key)];
+    e->key = key;
+    e->value = value;
+    m->used++;
+    return true;
+}
+
+/* Unmap key and return what it was mapped to, NULL if it was not. Later
+ * entries of its probe sequence are shifted back into the gap, so that no
+ * tombstones are needed.
+ */
+static const void *addr_remove(addr_map_t *m, const void *key)
+{
+    if (!m->used)
+        return NULL;
+    size_t i = addr_find(m, key);
+    if (!m->slots[i].key)
+        return NULL;
+
+    const void *value = m->slots[i].value;
+    size_t mask = m->capacity - 1;
+    for (size_t j = (i + 1) & mask; m->slots[j].key; j = (j + 1) & mask) {
+        size_t k = addr_home(m, m->slots[j].key);
+        /* Leave entries whose home slot lies cyclically in (i, j] */
+        if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+            continue;
+        m->slots[i] = m->slots[j];
+        i = j;
+    }
+    m->slots[i].key = NULL;
+    m->used--;
+
+    /* A failed shrink leaves the map as it is */
+    if (!m->used)
+        addr_clear(m);
+    else if (8 * m->used < m->capacity && m->capacity > ADDR_MIN_CAPACITY)
+        addr_resize(m, m->capacity / 2);
+    return value;
+}
+
+/* Call site recorded for block b, NULL if it is not profiled */
+static const void *profile_site_of(const block_element_t *b)
+{
+    addr_entry_t *e = addr_get(&profile_blocks, b);
+    return e ? e->value : NULL;
+}
+
+/* Statistics entry of site, claimed on first use */
+static profile_site_t *profile_entry(const void *site)
+{
+    size_t i = ((uintptr_t) site >> 2) % PROFILE_SITES;
+    for (size_t n = 0; n < PROFILE_SITES; n++) {
+        profile_site_t *e = &profile_sites[i];
+        if (e->site == site)
+            return e;
+        if (!e->site) {
+            e->site = site;
+            return e;
+        }
+        i = (i + 1) % PROFILE_SITES;
+    }
+    return &profile_sites[PROFILE_SITES];
+}
+
+/* Account size more live bytes to site, or fewer if shrink is set */
+static void profile_update(const void *site, size_t size, bool shrink)
+{
+    profile_site_t *e = profile_entry(site);
+    if (shrink) {
+        e->live_bytes -= size;
+        return;
+    }
+    e->live_bytes += size;
+    if (e->live_bytes > e->peak_bytes)
+        e->peak_bytes = e->live_bytes;
+}
+
+/* Count a new allocation of size bytes made from site */
+static void profile_alloc(const void *site, size_t size)
+{
+    profile_site_t *e = profile_entry(site);
+    int class = 0;
+    while (class < PROFILE_CLASSES - 1 && size > ((size_t) 16 << class))
+        class++;
+    e->count++;
+    e->bytes += size;
+    e->hist[class]++;
+    profile_update(site, size, false);
+}
+
+/* Chunk that would hold b if it came from an arena */
+static inline block_element_t *arena_chunk_of(const block_element_t *b)
+{
+    uintptr_t mask = ARENA_CHUNK_SIZE - 1;
+    return (block_element_t *) ((uintptr_t) b & ~mask);
+}
+
+/* Whether b, whose magic number is intact, is an allocated block.
+ * Blocks are checked through the links of their neighbours in the allocated
+ * list, which freeing touches anyway, and arena blocks through their chunk.
+ */
+static bool block_live(const block_element_t *b)
+{
+    if (b->source == BLOCK_ARENA)
+        return addr_get(&arena_chunks, arena_chunk_of(b));
+    if (b->prev ? b->prev->next != b : allocated != b)
+        return false;
+    return !b->next || b->next->prev == b;
+}
+
 /* Find header of block, given its payload.
  * Signal error if doesn't seem like legitimate block
  */
@@ -86,33 +427,159 @@ static block_element_t *find_header(void *p)
 
     block_element_t *b =
         (block_element_t *) ((size_t) p - sizeof(block_element_t));
-    if (cautious_mode) {
-        /* Make sure this is really an allocated block */
-        block_element_t *ab = allocated;
-        bool found = false;
-        while (ab && !found) {
-            found = ab == b;
-            ab = ab->next;
-        }
-        if (!found) {
-            report_event(MSG_ERROR,
-                         "Attempted to free unallocated block.  Address = %p",
-                         p);
-            error_occurred = true;
-        }
-    }
-
     if (b->magic_header != MAGICHEADER) {
         report_event(
             MSG_ERROR,
             "Attempted to free unallocated or corrupted block.  Address = %p",
             p);
         error_occurred = true;
+    } else if (cautious_mode && !block_live(b)) {
+        /* Make sure this is really an allocated block */
+        report_event(MSG_ERROR,
+                     "Attempted to free unallocated block.  Address = %p", p);
+        error_occurred = true;
+    }
+
+    return b;
+}
+
+/* Size of a block holding size bytes of payload, header and footer included */
+static inline size_t block_size(size_t size)
+{
+    return size + sizeof(block_element_t) + sizeof(size_t);
+}
+
+/* Take a block of at least bytes bytes from the slab pool */
+static block_element_t *pool_alloc(size_t bytes)
+{
+    size_t class = (bytes - 1) / POOL_ALIGN;
+    if (!pool_free_list[class]) {
+        pool_page_t *page = malloc(POOL_PAGE_SIZE);
+        if (!page)
+            return NULL;
+        page->next = pool_pages;
+        pool_pages = page;
+
+        /* Carve the fresh slab into blocks of this class */
+        size_t stride = (class + 1) * POOL_ALIGN;
+        unsigned char *start = (unsigned char *) page + POOL_ALIGN;
+        unsigned char *end = (unsigned char *) page + POOL_PAGE_SIZE;
+        for (unsigned char *cur = start; cur + stride <= end; cur += stride) {
+            block_element_t *b = (block_element_t *) cur;
+            b->next = pool_free_list[class];
+            pool_free_list[class] = b;
+        }
     }
 
+    block_element_t *b = pool_free_list[class];
+    pool_free_list[class] = b->next;
     return b;
 }
 
+/* Give a block back to the size class it came from */
+static void pool_release(block_element_t *b)
+{
+    size_t class = (block_size(b->payload_size) - 1) / POOL_ALIGN;
+    b->next = pool_free_list[class];
+    pool_free_list[class] = b;
+}
+
+/* Add a chunk of size bytes to arena group a.
+ * Return the chunk, or NULL if no memory is left.
+ */
+static arena_chunk_t *arena_grow(arena_group_t *a, size_t size)
+{
+    arena_chunk_t *chunk = aligned_alloc(ARENA_CHUNK_SIZE, size);
+    if (!chunk)
+        return NULL;
+    if (!addr_put(&arena_chunks, chunk, chunk)) {
+        free(chunk);
+        return NULL;
+    }
+
+    chunk->group = a;
+    chunk->next = a->chunks;
+    a->chunks = chunk;
+    if (!a->last)
+        a->last = chunk;
+    return chunk;
+}
+
+/* Carve a block of bytes bytes out of arena group a */
+static block_element_t *arena_alloc(arena_group_t *a, size_t bytes)
+{
+    size_t header = (sizeof(arena_chunk_t) + ARENA_ALIGN - 1) & -ARENA_ALIGN;
+    bytes = (bytes + ARENA_ALIGN - 1) & -ARENA_ALIGN;
+
+    if (header + bytes > ARENA_CHUNK_SIZE) {
+        /* Dedicated chunk, leaving the current one alone */
+        size_t size = (header + bytes + ARENA_CHUNK_SIZE - 1) &
+                      -(size_t) ARENA_CHUNK_SIZE;
+        arena_chunk_t *chunk = arena_grow(a, size);
+        return chunk ? (block_element_t *) ((unsigned char *) chunk + header)
+                     : NULL;
+    }
+
+    if ((size_t) (a->end - a->cur) < bytes) {
+        arena_chunk_t *chunk = arena_grow(a, ARENA_CHUNK_SIZE);
+        if (!chunk)
+            return NULL;
+        a->cur = (unsigned char *) chunk + header;
+        a->end = (unsigned char *) chunk + ARENA_CHUNK_SIZE;
+    }
+
+    block_element_t *b = (block_element_t *) a->cur;
+    a->cur += bytes;
+    return b;
+}
+
+/* Bytes mapped before the guard page of a block with size bytes of payload */
+static size_t guard_span(size_t size)
+{
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    size_t bytes = sizeof(block_element_t) +
+                   ((size + GUARD_ALIGN - 1) & -(size_t) GUARD_ALIGN);
+    return (bytes + page - 1) & -page;
+}
+
+/* Map a block with size bytes of payload whose end touches a PROT_NONE page,
+ * so that running off the payload faults at once.
+ * Return NULL, warning once per run of failures, when the kernel refuses the
+ * mapping, typically because vm.max_map_count is reached.
+ */
+static block_element_t *guard_alloc(size_t size)
+{
+    static bool warned;
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    size_t span = guard_span(size);
+    unsigned char *base = mmap(NULL, span + page, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base != MAP_FAILED && mprotect(base + span, page, PROT_NONE)) {
+        munmap(base, span + page);
+        base = MAP_FAILED;
+    }
+    if (base == MAP_FAILED) {
+        if (!warned)
+            report_event(MSG_WARN,
+                         "Out of guard pages, new blocks get footers instead");
+        warned = true;
+        return NULL;
+    }
+    warned = false;
+
+    size_t payload = (size + GUARD_ALIGN - 1) & -(size_t) GUARD_ALIGN;
+    return (block_element_t *) (base + span - payload -
+                                sizeof(block_element_t));
+}
+
+/* Unmap a guarded block together with its guard page */
+static void guard_release(block_element_t *b)
+{
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    void *base = (void *) ((uintptr_t) b & -(uintptr_t) page);
+    munmap(base, guard_span(b->payload_size) + page);
+}
+
 /* Given pointer to block, find its footer */
 static size_t *find_footer(block_element_t *b)
 {
@@ -122,7 +589,39 @@ static size_t *find_footer(block_element_t *b)
     return p;
 }
 
-static void *alloc(alloc_t alloc_type, size_t size)
+/* Padding bytes between the payload of guarded block b and its guard page */
+static inline size_t guard_slack(const block_element_t *b)
+{
+    return -b->payload_size & (GUARD_ALIGN - 1);
+}
+
+/* Mark the end of block b with its footer, or for a guarded block with
+ * canaries in the padding, which catch overruns too short to fault.
+ */
+static void seal_block(block_element_t *b)
+{
+    if (b->source == BLOCK_GUARD)
+        memset(b->payload + b->payload_size, GUARD_CANARY, guard_slack(b));
+    else
+        *find_footer(b) = MAGICFOOTER;
+}
+
+/* Whether the end mark of block b is intact */
+static bool block_intact(block_element_t *b)
+{
+    if (b->source != BLOCK_GUARD)
+        return *find_footer(b) == MAGICFOOTER;
+    for (size_t i = 0; i < guard_slack(b); i++) {
+        if (b->payload[b->payload_size + i] != GUARD_CANARY)
+            return false;
+    }
+    return true;
+}
+
+static void *alloc(alloc_t alloc_type,
+                   size_t size,
+                   arena_group_t *arena,
+                   const void *site)
 {
     if (noallocate_mode) {
         char *msg_alloc_forbidden[] = {
@@ -142,20 +641,55 @@ static void *alloc(alloc_t alloc_type, size_t size)
         return NULL;
     }
 
-    block_element_t *new_block =
-        malloc(size + sizeof(block_element_t) + sizeof(size_t));
+    if (exceed_limit(size))
+        return NULL;
+
+    size_t bytes = block_size(size);
+    block_source_t source = BLOCK_MALLOC;
+    block_element_t *new_block;
+    if (arena) {
+        source = BLOCK_ARENA;
+        new_block = arena_alloc(arena, bytes);
+    } else if (guard_mode && (new_block = guard_alloc(size))) {
+        /* Past the mapping limit, blocks fall back to the cases below */
+        source = BLOCK_GUARD;
+    } else if (pool_mode && bytes <= POOL_MAX_BLOCK) {
+        source = BLOCK_POOL;
+        new_block = pool_alloc(bytes);
+    } else {
+        new_block = malloc(bytes);
+    }
     if (!new_block) {
         report_event(MSG_FATAL, "Couldn't allocate any more memory");
         error_occurred = true;
     }
 
+    // cppcheck-suppress nullPointerRedundantCheck
+    new_block->source = source;
+    /* Arena blocks may vanish with their arena, which is not accounted for */
+    if (profile_mode && source != BLOCK_ARENA &&
+        addr_put(&profile_blocks, new_block, site))
+        profile_alloc(site, size);
     // cppcheck-suppress nullPointerRedundantCheck
     new_block->magic_header = MAGICHEADER;
     // cppcheck-suppress nullPointerRedundantCheck
     new_block->payload_size = size;
-    *find_footer(new_block) = MAGICFOOTER;
+    seal_block(new_block);
     void *p = (void *) &new_block->payload;
-    memset(p, !alloc_type * FILLCHAR, size);
+    if (alloc_type == TEST_CALLOC)
+        memset(p, 0, size);
+    else if (scrub_payload())
+        memset(p, FILLCHAR, size);
+    allocated_count++;
+    account_bytes(size, false);
+
+    /* Arena blocks are tracked by their chunk and go away with the arena */
+    if (source == BLOCK_ARENA) {
+        arena->live++;
+        arena->bytes += size;
+        return p;
+    }
+
     // cppcheck-suppress nullPointerRedundantCheck
     new_block->next = allocated;
     // cppcheck-suppress nullPointerRedundantCheck
@@ -164,7 +698,6 @@ static void *alloc(alloc_t alloc_type, size_t size)
     if (allocated)
         allocated->prev = new_block;
     allocated = new_block;
-    allocated_count++;
 
     return p;
 }
@@ -173,7 +706,7 @@ static void *alloc(alloc_t alloc_type, size_t size)
 
 void *test_malloc(size_t size)
 {
-    return alloc(TEST_MALLOC, size);
+    return alloc(TEST_MALLOC, size, NULL, __builtin_return_address(0));
 }
 
 // cppcheck-suppress unusedFunction
@@ -184,7 +717,8 @@ void *test_calloc(size_t nelem, size_t elsize)
      */
     if (!nelem || !elsize || nelem > SIZE_MAX / elsize)
         return NULL;
-    return alloc(TEST_CALLOC, nelem * elsize);
+    return alloc(TEST_CALLOC, nelem * elsize, NULL,
+                 __builtin_return_address(0));
 }
 
 void test_free(void *p)
@@ -198,8 +732,11 @@ void test_free(void *p)
         return;
 
     block_element_t *b = find_header(p);
-    size_t footer = *find_footer(b);
-    if (footer != MAGICFOOTER) {
+    bool guarded = b->source == BLOCK_GUARD;
+    const void *site = addr_remove(&profile_blocks, b);
+    if (site)
+        profile_update(site, b->payload_size, true);
+    if (!block_intact(b)) {
         report_event(MSG_ERROR,
                      "Corruption detected in block with address %p when "
                      "attempting to free it",
@@ -207,8 +744,21 @@ void test_free(void *p)
         error_occurred = true;
     }
     b->magic_header = MAGICFREE;
-    *find_footer(b) = MAGICFREE;
-    memset(p, FILLCHAR, b->payload_size);
+    if (!guarded)
+        *find_footer(b) = MAGICFREE;
+    /* Guarded blocks are unmapped, later accesses fault anyway */
+    if (!guarded && scrub_payload())
+        memset(p, FILLCHAR, b->payload_size);
+    allocated_count--;
+    account_bytes(b->payload_size, true);
+
+    /* Arena blocks are only given back when the whole arena is released */
+    if (b->source == BLOCK_ARENA) {
+        arena_group_t *a = ((arena_chunk_t *) arena_chunk_of(b))->group;
+        a->live--;
+        a->bytes -= b->payload_size;
+        return;
+    }
 
     /* Unlink from list */
     block_element_t *bn = b->next;
@@ -220,26 +770,351 @@ void test_free(void *p)
     if (bn)
         bn->prev = bp;
 
-    free(b);
-    allocated_count--;
+    if (b->source == BLOCK_POOL)
+        pool_release(b);
+    else if (guarded)
+        guard_release(b);
+    else
+        free(b);
+}
+
+// cppcheck-suppress unusedFunction
+void *test_realloc(void *p, size_t size)
+{
+    const void *site = __builtin_return_address(0);
+    if (!p)
+        return alloc(TEST_MALLOC, size, NULL, site);
+    if (!size) {
+        test_free(p);
+        return NULL;
+    }
+
+    if (noallocate_mode) {
+        report_event(MSG_FATAL, "Calls to realloc are disallowed");
+        return NULL;
+    }
+
+    block_element_t *b = find_header(p);
+    if (!block_intact(b)) {
+        report_event(MSG_ERROR,
+                     "Corruption detected in block with address %p when "
+                     "attempting to reallocate it",
+                     p);
+        error_occurred = true;
+    }
+
+    if (fail_allocation()) {
+        report_event(MSG_WARN, "Realloc returning NULL");
+        return NULL;
+    }
+
+    size_t old_size = b->payload_size;
+    if (size > old_size && exceed_limit(size - old_size))
+        return NULL;
+
+    size_t old_bytes = block_size(old_size), bytes = block_size(size);
+    bool in_place = false;
+    if (b->source == BLOCK_MALLOC) {
+        /* The system allocator grows in place when it can, and otherwise
+         * moves the block, after which its neighbours must be relinked and
+         * its profile entry rekeyed.
+         */
+        const void *prof = addr_remove(&profile_blocks, b);
+        block_element_t *nb = realloc(b, bytes);
+        if (!nb) {
+            if (prof)
+                addr_put(&profile_blocks, b, prof);
+            report_event(MSG_WARN, "Realloc returning NULL");
+            return NULL;
+        }
+        b = nb;
+        if (b->prev)
+            b->prev->next = b;
+        else
+            allocated = b;
+        if (b->next)
+            b->next->prev = b;
+        if (prof && !addr_put(&profile_blocks, b, prof))
+            profile_update(prof, old_size, true);
+        in_place = true;
+    } else if (b->source == BLOCK_POOL) {
+        /* Stay in the slot while the size class does not change */
+        in_place = bytes <= POOL_MAX_BLOCK &&
+                   (bytes - 1) / POOL_ALIGN == (old_bytes - 1) / POOL_ALIGN;
+    } else if (b->source == BLOCK_ARENA) {
+        /* Shrink anywhere, grow only the block carved last */
+        arena_group_t *a = ((arena_chunk_t *) arena_chunk_of(b))->group;
+        size_t old_span = (old_bytes + ARENA_ALIGN - 1) & -ARENA_ALIGN;
+        size_t span = (bytes + ARENA_ALIGN - 1) & -ARENA_ALIGN;
+        unsigned char *start = (unsigned char *) b;
+        if (span <= old_span) {
+            in_place = true;
+        } else if (start + old_span == a->cur &&
+                   span - old_span <= (size_t) (a->end - a->cur)) {
+            a->cur += span - old_span;
+            in_place = true;
+        }
+    }
+
+    if (in_place) {
+        size_t delta = size > old_size ? size - old_size : old_size - size;
+        const void *prof = profile_site_of(b);
+        if (prof)
+            profile_update(prof, delta, size < old_size);
+        account_bytes(delta, size < old_size);
+        if (b->source == BLOCK_ARENA)
+            ((arena_chunk_t *) arena_chunk_of(b))->group->bytes +=
+                size - old_size;
+        b->payload_size = size;
+        seal_block(b);
+        if (size > old_size && scrub_payload())
+            memset(b->payload + old_size, FILLCHAR, size - old_size);
+        return b->payload;
+    }
+
+    /* Move to a new block, from the same arena if there is one */
+    arena_group_t *arena = NULL;
+    if (b->source == BLOCK_ARENA)
+        arena = ((arena_chunk_t *) arena_chunk_of(b))->group;
+    void *q = alloc(TEST_MALLOC, size, arena, site);
+    if (!q)
+        return NULL;
+    memcpy(q, p, old_size < size ? old_size : size);
+    test_free(p);
+    return q;
 }
 
 // cppcheck-suppress unusedFunction
 char *test_strdup(const char *s)
 {
     size_t len = strlen(s) + 1;
-    void *new = test_malloc(len);
+    void *new = alloc(TEST_MALLOC, len, NULL, __builtin_return_address(0));
     if (!new)
         return NULL;
 
     return memcpy(new, s, len);
 }
 
+test_arena_t *test_arena_new(void)
+{
+    /* Arena blocks are neither guarded nor profiled, keep them out of the way
+     */
+    if (!arena_mode || guard_mode || profile_mode)
+        return NULL;
+
+    arena_group_t *group = calloc(1, sizeof(arena_group_t));
+    test_arena_t *arena = malloc(sizeof(test_arena_t));
+    if (!group || !arena) {
+        free(group);
+        free(arena);
+        return NULL;
+    }
+    arena->group = group;
+    arena->next = NULL;
+    group->handles = arena;
+    return arena;
+}
+
+test_arena_t *test_arena_share(test_arena_t *arena)
+{
+    if (!arena)
+        return NULL;
+
+    test_arena_t *handle = malloc(sizeof(test_arena_t));
+    if (!handle)
+        return NULL;
+    handle->group = arena->group;
+    handle->next = arena->group->handles;
+    arena->group->handles = handle;
+    return handle;
+}
+
+bool test_arena_shared(const test_arena_t *arena)
+{
+    return arena && arena->group->handles->next;
+}
+
+void *test_arena_alloc(test_arena_t *arena, size_t size)
+{
+    return alloc(TEST_MALLOC, size, arena ? arena->group : NULL,
+                 __builtin_return_address(0));
+}
+
+void test_arena_merge(test_arena_t *dst, test_arena_t *src)
+{
+    if (!dst || !src || dst->group == src->group)
+        return;
+
+    arena_group_t *to = dst->group, *from = src->group;
+    for (arena_chunk_t *chunk = from->chunks; chunk; chunk = chunk->next)
+        chunk->group = to;
+
+    /* Append so that dst keeps carving its current chunk */
+    if (from->chunks) {
+        if (to->last)
+            to->last->next = from->chunks;
+        else
+            to->chunks = from->chunks;
+        to->last = from->last;
+    }
+    to->live += from->live;
+    to->bytes += from->bytes;
+    if (!to->cur) {
+        to->cur = from->cur;
+        to->end = from->end;
+    }
+
+    /* Every handle on src's group now refers to dst's */
+    test_arena_t *handle = from->handles;
+    while (handle) {
+        test_arena_t *next = handle->next;
+        handle->group = to;
+        handle->next = to->handles;
+        to->handles = handle;
+        handle = next;
+    }
+    free(from);
+}
+
+void test_arena_release(test_arena_t *arena)
+{
+    if (!arena)
+        return;
+
+    arena_group_t *group = arena->group;
+    test_arena_t **link = &group->handles;
+    while (*link != arena)
+        link = &(*link)->next;
+    *link = arena->next;
+    free(arena);
+    if (group->handles)
+        return;
+
+    arena_chunk_t *chunk = group->chunks;
+    while (chunk) {
+        arena_chunk_t *next = chunk->next;
+        addr_remove(&arena_chunks, chunk);
+        free(chunk);
+        chunk = next;
+    }
+    allocated_count -= group->live;
+    account_bytes(group->bytes, true);
+    free(group);
+}
+
+void *test_scratch(size_t size)
+{
+    /* Keep the buffer unless it is more than four times too large */
+    if (size <= scratch_size &&
+        (size > scratch_size / 4 || scratch_size <= 4096))
+        return scratch;
+
+    /* Resize in powers of two so that repeated requests settle quickly */
+    size_t new_size = 4096;
+    while (new_size < size)
+        new_size *= 2;
+    void *p = realloc(scratch, new_size);
+    if (!p)
+        return size <= scratch_size ? scratch : NULL;
+    scratch = p;
+    scratch_size = new_size;
+    return scratch;
+}
+
+void scratch_release()
+{
+    free(scratch);
+    scratch = NULL;
+    scratch_size = 0;
+}
+
 size_t allocation_check()
 {
     return allocated_count;
 }
 
+void allocation_stat(mem_stat_t *stat)
+{
+    stat->live_blocks = allocated_count;
+    stat->live_bytes = allocated_bytes;
+    stat->peak_bytes = allocated_peak;
+    stat->overhead_bytes = allocated_count * block_size(0);
+}
+
+void harness_stat(harness_stat_t *stat)
+{
+    stat->scratch = scratch_size;
+    stat->tables = (arena_chunks.capacity + profile_blocks.capacity) *
+                   sizeof(addr_entry_t);
+    stat->pool_slabs = 0;
+    for (pool_page_t *page = pool_pages; page; page = page->next)
+        stat->pool_slabs += POOL_PAGE_SIZE;
+}
+
+/* Order profile entries by decreasing bytes allocated */
+static int profile_cmp(const void *a, const void *b)
+{
+    const profile_site_t *x = *(const profile_site_t **) a;
+    const profile_site_t *y = *(const profile_site_t **) b;
+    return (x->bytes < y->bytes) - (x->bytes > y->bytes);
+}
+
+void profile_report(int limit)
+{
+    static profile_site_t *order[PROFILE_SITES + 1];
+    int n = 0;
+    for (int i = 0; i <= PROFILE_SITES; i++) {
+        if (profile_sites[i].count)
+            order[n++] = &profile_sites[i];
+    }
+    qsort(order, n, sizeof(order[0]), profile_cmp);
+
+    report(1, "%-32s %10s %12s %12s %12s", "site", "count", "bytes", "live",
+           "peak");
+    for (int i = 0; i < n && i < limit; i++) {
+        profile_site_t *e = order[i];
+        char name[32] = "(other sites)";
+        Dl_info info;
+        if (e->site && dladdr(e->site, &info) && info.dli_fname) {
+            const char *file = strrchr(info.dli_fname, '/');
+            file = file ? file + 1 : info.dli_fname;
+            /* Offsets into the executable can be fed to addr2line */
+            if (info.dli_sname)
+                snprintf(name, sizeof(name), "%s+%#lx", info.dli_sname,
+                         (unsigned long) ((uintptr_t) e->site -
+                                          (uintptr_t) info.dli_saddr));
+            else
+                snprintf(name, sizeof(name), "%s+%#lx", file,
+                         (unsigned long) ((uintptr_t) e->site -
+                                          (uintptr_t) info.dli_fbase));
+        } else if (e->site) {
+            snprintf(name, sizeof(name), "%p", e->site);
+        }
+        report(1, "%-32s %10zu %12zu %12zu %12zu", name, e->count, e->bytes,
+               e->live_bytes, e->peak_bytes);
+
+        char hist[256];
+        size_t len = 0;
+        for (int c = 0; c < PROFILE_CLASSES; c++) {
+            if (!e->hist[c])
+                continue;
+            if (c < PROFILE_CLASSES - 1)
+                len += snprintf(hist + len, sizeof(hist) - len, " <=%zu:%zu",
+                                (size_t) 16 << c, e->hist[c]);
+            else
+                len += snprintf(hist + len, sizeof(hist) - len, " >%zu:%zu",
+                                (size_t) 16 << (c - 1), e->hist[c]);
+        }
+        report(1, "    sizes%s", hist);
+    }
+}
+
+void profile_reset()
+{
+    memset(profile_sites, 0, sizeof(profile_sites));
+    addr_clear(&profile_blocks);
+}
+
 /* Implementation of functions for testing */
 
 /* Set/unset cautious mode.
@@ -14,16 +14,110 @@ void *test_malloc(size_t size);
 void *test_calloc(size_t nmemb, size_t size);
 void test_free(void *p);
 char *test_strdup(const char *s);
-/* FIXME: provide test_realloc as well */
+
+/* Resize the block at p to size bytes, in place when the block allows it.
+ * Behaves like realloc(): a NULL p allocates, a zero size frees, and on
+ * failure NULL is returned with the original block left untouched.
+ */
+void *test_realloc(void *p, size_t size);
+
+/* Borrow a scratch buffer of at least size bytes owned by the harness.
+ * The buffer stays valid until the next call, is not counted as an allocated
+ * block, and may be requested even when allocation is disallowed.
+ * Return NULL if the buffer cannot be made large enough.
+ */
+void *test_scratch(size_t size);
+
+/* Arena from which many blocks can be allocated and then released together.
+ * Blocks from an arena are checked and counted like any other block, and may
+ * be passed to test_free(), but their memory is only reused once the whole
+ * arena is released.
+ */
+typedef struct test_arena test_arena_t;
+
+/* Create an empty arena.
+ * Return NULL if arenas are disabled or no memory is left, in which case the
+ * other arena functions fall back to plain blocks.
+ */
+test_arena_t *test_arena_new(void);
+
+/* Allocate size bytes from arena, or with test_malloc() if arena is NULL */
+void *test_arena_alloc(test_arena_t *arena, size_t size);
+
+/* Create another handle on the memory of arena, which is kept until every
+ * handle is released. Return NULL if no memory is left.
+ */
+test_arena_t *test_arena_share(test_arena_t *arena);
+
+/* Return whether other handles use the memory of arena */
+bool test_arena_shared(const test_arena_t *arena);
+
+/* Let dst and src, and every handle sharing either, use the same memory */
+void test_arena_merge(test_arena_t *dst, test_arena_t *src);
+
+/* Release arena. Once no handle uses its memory any more, free it together
+ * with every block still allocated from it.
+ */
+void test_arena_release(test_arena_t *arena);
 
 #ifdef INTERNAL
 
+#include "report.h"
+
 /* Report number of allocated blocks */
 size_t allocation_check();
 
+/* Give the buffer handed out by test_scratch() back to the system */
+void scratch_release();
+
+/* Fill stat with the usage of blocks allocated through the harness */
+void allocation_stat(mem_stat_t *stat);
+
+/* Bytes the harness holds for itself, outside of any block */
+typedef struct {
+    size_t scratch;    /* Buffer handed out by test_scratch() */
+    size_t tables;     /* Maps of arena chunks and profiled blocks */
+    size_t pool_slabs; /* Slabs carved by pool mode, whether used or not */
+} harness_stat_t;
+
+/* Fill stat with the memory the harness holds for itself */
+void harness_stat(harness_stat_t *stat);
+
+/* Print the limit call sites which allocated the most bytes while profiling,
+ * with their allocation count, live and peak bytes and size histogram.
+ */
+void profile_report(int limit);
+
+/* Forget all statistics gathered by the profiler */
+void profile_reset();
+
 /* Probability of malloc failing, expressed as percent */
 extern int fail_probability;
 
+/* Nonzero to serve small blocks from preallocated slabs instead of malloc */
+extern int pool_mode;
+
+/* Nonzero to let test_arena_new() hand out arenas */
+extern int arena_mode;
+
+/* Nonzero to map each block with an inaccessible page right after its
+ * payload, so that overruns fault immediately. The few bytes of padding that
+ * keep the payload aligned are checked when the block is freed instead.
+ * Takes precedence over pool mode and disables arenas for queues created
+ * meanwhile. Each block is a mapping of its own that counts twice against
+ * vm.max_map_count (65530 by default), so past some 32000 live blocks new
+ * blocks get a footer as usual, with a warning.
+ */
+extern int guard_mode;
+
+/* Nonzero to record allocations per call site, see profile_report() */
+extern int profile_mode;
+
+/* Fill one in this many payloads with garbage when allocated or freed.
+ * 1 fills every payload, 0 none. Header and footer checks are unaffected.
+ */
+extern int scrub_interval;
+
 /*
  * Set/unset cautious mode.
  * In this mode, makes extra sure any block to be freed is currently allocated.
@@ -57,6 +151,7 @@ void trigger_exception(char *msg);
 #define malloc test_malloc
 #define calloc test_calloc
 #define free test_free
+#define realloc test_realloc
 
 /* Use undef to avoid strdup redefined error */
 #undef strdup
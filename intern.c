@@ -0,0 +1,125 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "harness.h"
+#include "intern.h"
+
+/* Interned strings are chained in buckets by their FNV-1a hash. The bucket
+ * array doubles whenever there are more strings than buckets.
+ */
+#define INTERN_MIN_BUCKETS 64
+
+typedef struct intern_entry {
+    struct intern_entry *next;
+    uint64_t hash;
+    size_t refs, len;
+    char data[];
+} intern_entry_t;
+
+static intern_entry_t **buckets = NULL;
+static size_t n_buckets = 0;
+static size_t n_strings = 0, n_bytes = 0;
+
+static uint64_t intern_hash(const char *s, size_t len)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char) s[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+/* Double the bucket array, or allocate the first one */
+static bool intern_grow(void)
+{
+    size_t size = n_buckets ? 2 * n_buckets : INTERN_MIN_BUCKETS;
+    intern_entry_t **table = calloc(size, sizeof(intern_entry_t *));
+    if (!table)
+        return false;
+
+    for (size_t i = 0; i < n_buckets; i++) {
+        intern_entry_t *e = buckets[i], *next;
+        for (; e; e = next) {
+            next = e->next;
+            intern_entry_t **slot = &table[e->hash & (size - 1)];
+            e->next = *slot;
+            *slot = e;
+        }
+    }
+    free(buckets);
+    buckets = table;
+    n_buckets = size;
+    return true;
+}
+
+char *intern_get(const char *s, size_t len)
+{
+    uint64_t hash = intern_hash(s, len);
+    if (n_buckets) {
+        intern_entry_t *e = buckets[hash & (n_buckets - 1)];
+        for (; e; e = e->next) {
+            if (e->hash == hash && e->len == len && !memcmp(e->data, s, len)) {
+                e->refs++;
+                return e->data;
+            }
+        }
+    }
+
+    /* A full table still works, only with longer chains */
+    if (n_strings >= n_buckets && !intern_grow() && !n_buckets)
+        return NULL;
+
+    intern_entry_t *e = malloc(sizeof(intern_entry_t) + len + 1);
+    if (!e) {
+        if (!n_strings) {
+            free(buckets);
+            buckets = NULL;
+            n_buckets = 0;
+        }
+        return NULL;
+    }
+    memcpy(e->data, s, len);
+    e->data[len] = '\0';
+    e->hash = hash;
+    e->refs = 1;
+    e->len = len;
+
+    intern_entry_t **slot = &buckets[hash & (n_buckets - 1)];
+    e->next = *slot;
+    *slot = e;
+    n_strings++;
+    n_bytes += len + 1;
+    return e->data;
+}
+
+void intern_put(char *s)
+{
+    intern_entry_t *e =
+        (intern_entry_t *) (s - offsetof(intern_entry_t, data));
+    if (--e->refs)
+        return;
+
+    intern_entry_t **slot = &buckets[e->hash & (n_buckets - 1)];
+    while (*slot != e)
+        slot = &(*slot)->next;
+    *slot = e->next;
+    n_strings--;
+    n_bytes -= e->len + 1;
+    free(e);
+
+    if (!n_strings) {
+        free(buckets);
+        buckets = NULL;
+        n_buckets = 0;
+    }
+}
+
+size_t intern_count(size_t *bytes)
+{
+    if (bytes)
+        *bytes = n_bytes;
+    return n_strings;
+}
@@ -0,0 +1,25 @@
+#ifndef LAB0_INTERN_H
+#define LAB0_INTERN_H
+
+/* Table of interned strings.
+ * Equal strings interned at the same time share one copy, kept in a hash
+ * table with a count of the references to it. The copy is freed when the
+ * last reference is dropped, and the table itself once it is empty.
+ */
+
+#include <stddef.h>
+
+/* Return the interned copy of the len bytes at s, which are followed by a
+ * terminator, and take a reference on it. Return NULL if no memory is left.
+ */
+char *intern_get(const char *s, size_t len);
+
+/* Drop a reference on a string returned by intern_get() */
+void intern_put(char *s);
+
+/* Return the number of distinct strings interned. If bytes is not NULL, store
+ * the number of bytes the strings take there.
+ */
+size_t intern_count(size_t *bytes);
+
+#endif /* LAB0_INTERN_H */
@@ -0,0 +1,121 @@
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "harness.h"
+#include "mpmc.h"
+
+/* Bounded queue after Dmitry Vyukov's design.
+ * Each cell of the ring carries a sequence number telling which lap of the
+ * ring it is ready for. A producer claims the tail position with a
+ * compare-and-swap once the cell there has been emptied on the previous lap,
+ * stores the element and publishes it by advancing the sequence number.
+ * Consumers do the same at the head, so an operation that does not find the
+ * queue full or empty takes a single successful compare-and-swap. Producers
+ * and consumers only contend on the cells they share.
+ *
+ * The positions are padded apart so that producers and consumers do not
+ * bounce one cache line between them.
+ */
+#define MPMC_LINE 64
+
+typedef struct {
+    atomic_size_t seq;
+    element_t *e;
+} mpmc_cell_t;
+
+struct mpmc {
+    mpmc_cell_t *cells;
+    size_t mask;
+    char pad0[MPMC_LINE];
+    atomic_size_t tail;
+    char pad1[MPMC_LINE];
+    atomic_size_t head;
+    char pad2[MPMC_LINE];
+};
+
+mpmc_t *mpmc_new(size_t capacity)
+{
+    size_t size = 2;
+    while (size < capacity)
+        size *= 2;
+
+    mpmc_t *q = malloc(sizeof(mpmc_t));
+    if (!q)
+        return NULL;
+    q->cells = malloc(size * sizeof(mpmc_cell_t));
+    if (!q->cells) {
+        free(q);
+        return NULL;
+    }
+    for (size_t i = 0; i < size; i++)
+        atomic_init(&q->cells[i].seq, i);
+    q->mask = size - 1;
+    atomic_init(&q->tail, 0);
+    atomic_init(&q->head, 0);
+    return q;
+}
+
+void mpmc_free(mpmc_t *q)
+{
+    if (!q)
+        return;
+    free(q->cells);
+    free(q);
+}
+
+bool mpmc_insert_tail(mpmc_t *q, element_t *e)
+{
+    size_t pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    for (;;) {
+        mpmc_cell_t *cell = &q->cells[pos & q->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+
+        if (!diff) {
+            /* A failed exchange reloads pos */
+            if (atomic_compare_exchange_weak_explicit(
+                    &q->tail, &pos, pos + 1, memory_order_relaxed,
+                    memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            /* The cell still holds the element of the previous lap */
+            return false;
+        } else {
+            pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+        }
+    }
+
+    mpmc_cell_t *cell = &q->cells[pos & q->mask];
+    cell->e = e;
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+    return true;
+}
+
+element_t *mpmc_remove_head(mpmc_t *q)
+{
+    size_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+    for (;;) {
+        mpmc_cell_t *cell = &q->cells[pos & q->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t) seq - (intptr_t) (pos + 1);
+
+        if (!diff) {
+            if (atomic_compare_exchange_weak_explicit(
+                    &q->head, &pos, pos + 1, memory_order_relaxed,
+                    memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            /* No element has been published in the cell on this lap */
+            return NULL;
+        } else {
+            pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+        }
+    }
+
+    mpmc_cell_t *cell = &q->cells[pos & q->mask];
+    element_t *e = cell->e;
+    /* Hand the cell over to the producer of the next lap */
+    atomic_store_explicit(&cell->seq, pos + q->mask + 1, memory_order_release);
+    return e;
+}
@@ -0,0 +1,32 @@
+#ifndef LAB0_MPMC_H
+#define LAB0_MPMC_H
+
+/* Bounded lock-free queue of elements for many producers and consumers.
+ * Unlike the queues of queue.c, it may be used by several threads at once.
+ * It only keeps pointers to the elements, which stay owned by the caller, and
+ * allocates all its memory up front, so that no memory has to be reclaimed
+ * while other threads may still be reading it.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "queue.h"
+
+typedef struct mpmc mpmc_t;
+
+/* Create a queue holding at least capacity elements, rounded up to a power of
+ * two. Return NULL if no memory is left.
+ */
+mpmc_t *mpmc_new(size_t capacity);
+
+/* Free a queue no thread uses any more, without touching its elements */
+void mpmc_free(mpmc_t *q);
+
+/* Add e at the tail. Return false if the queue is full. */
+bool mpmc_insert_tail(mpmc_t *q, element_t *e);
+
+/* Remove and return the element at the head, NULL if the queue is empty */
+element_t *mpmc_remove_head(mpmc_t *q);
+
+#endif /* LAB0_MPMC_H */
@@ -3,12 +3,16 @@
 #include <assert.h>
 #include <errno.h>
 #include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
 #include <signal.h>
 #include <spawn.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h> /* strcasecmp */
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <unistd.h>
@@ -45,6 +49,7 @@ extern int show_entropy;
 #include "queue.h"
 
 #include "console.h"
+#include "mpmc.h"
 #include "report.h"
 
 /* Settable parameters */
@@ -53,7 +58,6 @@ extern int show_entropy;
 
 /* How large is a queue before it's considered big.
  * This affects how it gets printed
- * and whether cautious mode is used when freeing the queue
  */
 #define BIG_LIST_SIZE 30
 
@@ -77,6 +81,9 @@ static int descend = 0;
 
 #define MIN_RANDSTR_LEN 5
 #define MAX_RANDSTR_LEN 10
+
+/* Number of strings handed to the bulk insert functions at once */
+#define INSERT_BATCH 256
 static const char charset[] = "abcdefghijklmnopqrstuvwxyz";
 /* For queue_insert and queue_remove */
 typedef enum {
@@ -101,9 +108,6 @@ static bool do_free(int argc, char *argv[])
     }
     error_check();
 
-    if (current && current->size > BIG_LIST_SIZE)
-        set_cautious_mode(false);
-
     struct list_head *qnext = NULL;
     if (chain.size > 1) {
         qnext = (current->chain.next == &chain.head) ? chain.head.next
@@ -116,7 +120,6 @@ static bool do_free(int argc, char *argv[])
         if (exception_setup(true))
             q_free(current->q);
         exception_cancel();
-        set_cautious_mode(true);
     }
 
     if (current) {
@@ -127,6 +130,10 @@ static bool do_free(int argc, char *argv[])
 
     q_show(3);
 
+    /* Without queues, nothing is left to sort with the scratch buffer */
+    if (!chain.size)
+        scratch_release();
+
     size_t bcnt = allocation_check();
     if (!chain.size && bcnt > 0) {
         report(1,
@@ -138,6 +145,91 @@ static bool do_free(int argc, char *argv[])
     return ok && !error_check();
 }
 
+static bool do_dk(int argc, char *argv[])
+{
+    if (argc != 2) {
+        report(1, "%s needs 1 argument", argv[0]);
+        return false;
+    }
+
+    int k;
+    if (!get_int(argv[1], &k)) {
+        report(1, "Invalid position '%s'", argv[1]);
+        return false;
+    }
+
+    if (!current || !current->q) {
+        report(3, "Warning: Try to access null queue");
+        return false;
+    }
+    error_check();
+
+    bool ok = true;
+    if (exception_setup(true))
+        ok = q_delete_at(current->q, k);
+    exception_cancel();
+
+    bool in_range = k >= 0 && k < current->size;
+    if (ok != in_range) {
+        report(1, "ERROR: Deleting position %d of %d elements returned %s", k,
+               current->size, ok ? "true" : "false");
+        ok = false;
+    } else if (ok) {
+        --current->size;
+    } else {
+        report(3, "Warning: Position %d is out of range", k);
+        ok = true;
+    }
+    q_show(3);
+    return ok && !error_check();
+}
+
+static bool do_split(int argc, char *argv[])
+{
+    if (argc != 2) {
+        report(1, "%s needs 1 argument", argv[0]);
+        return false;
+    }
+
+    int k;
+    if (!get_int(argv[1], &k) || k < 0) {
+        report(1, "Invalid position '%s'", argv[1]);
+        return false;
+    }
+
+    if (!current || !current->q) {
+        report(3, "Warning: Try to access null queue");
+        return false;
+    }
+    error_check();
+
+    queue_contex_t *qctx = NULL;
+    int moved = 0;
+    if (exception_setup(true)) {
+        qctx = malloc(sizeof(queue_contex_t));
+        list_add_tail(&qctx->chain, &chain.head);
+        qctx->size = 0;
+        qctx->q = q_new();
+        qctx->id = chain.size++;
+        moved = q_split(current->q, qctx->q, k);
+    }
+    exception_cancel();
+
+    bool ok = true;
+    int expect = k < current->size ? current->size - k : 0;
+    if (moved != expect) {
+        report(1, "ERROR: Split moved %d elements, expected %d", moved, expect);
+        ok = false;
+    }
+    if (qctx && moved >= 0 && moved <= current->size) {
+        current->size -= moved;
+        qctx->size = moved;
+        report(2, "Moved %d elements to queue %d", moved, qctx->id);
+    }
+    q_show(3);
+    return ok && !error_check();
+}
+
 static bool do_new(int argc, char *argv[])
 {
     if (argc != 1) {
@@ -181,6 +273,88 @@ static void fill_rand_string(char *buf, size_t buf_size)
 }
 
 /* insertion */
+/* Count a failed insertion of s, return false once it is one too many */
+static bool insert_failed(const char *s)
+{
+    fail_count++;
+    if (fail_count < fail_limit) {
+        report(2, "Insertion of %s failed", s);
+        return true;
+    }
+    report(1, "ERROR: Insertion of %s failed (%d failures total)", s,
+           fail_count);
+    return false;
+}
+
+/* Insert reps copies of inserts, or random strings if need_rand is set, with
+ * the bulk insert functions, INSERT_BATCH strings at a time.
+ */
+static bool queue_insert_bulk(position_t pos,
+                              char *inserts,
+                              bool need_rand,
+                              int reps)
+{
+    static char randstrs[INSERT_BATCH][MAX_RANDSTR_LEN];
+    char *strs[INSERT_BATCH];
+    char *lasts = NULL;
+    bool ok = true;
+
+    for (int r = 0; ok && r < reps;) {
+        int n = reps - r < INSERT_BATCH ? reps - r : INSERT_BATCH;
+        for (int i = 0; i < n; i++) {
+            if (need_rand) {
+                fill_rand_string(randstrs[i], sizeof(randstrs[i]));
+                strs[i] = randstrs[i];
+            } else {
+                strs[i] = inserts;
+            }
+        }
+
+        int done = pos == POS_TAIL ? q_insert_tail_bulk(current->q, strs, n)
+                                   : q_insert_head_bulk(current->q, strs, n);
+        if (done < 0 || done > n) {
+            report(1, "ERROR: Bulk insertion reported %d of %d strings", done,
+                   n);
+            return false;
+        }
+        current->size += done;
+
+        /* Visit the new elements from the head; at the head of the queue
+         * they come in reverse order of insertion
+         */
+        q_iter_t it;
+        q_iter_init(&it, current->q,
+                    pos == POS_TAIL ? current->size - done : 0);
+        for (int i = 0; ok && i < done; i++) {
+            char *cur_inserts = q_iter_next(&it)->value;
+            char *src = strs[pos == POS_TAIL ? i : done - 1 - i];
+            if (!cur_inserts) {
+                report(1, "ERROR: Failed to save copy of string in queue");
+                ok = false;
+            } else if (cur_inserts == src) {
+                report(1,
+                       "ERROR: Need to allocate and copy string for new "
+                       "queue element");
+                ok = false;
+            } else if (cur_inserts == lasts) {
+                report(1,
+                       "ERROR: Need to allocate separate string for each "
+                       "queue element");
+                ok = false;
+            }
+            lasts = cur_inserts;
+        }
+
+        r += done;
+        if (done < n) {
+            ok = ok && insert_failed(strs[done]);
+            r++;
+        }
+        ok = ok && !error_check();
+    }
+    return ok;
+}
+
 static bool queue_insert(position_t pos, int argc, char *argv[])
 {
     if (simulation) {
@@ -199,7 +373,6 @@ static bool queue_insert(position_t pos, int argc, char *argv[])
         return ok;
     }
 
-    char *lasts = NULL;
     char randstr_buf[MAX_RANDSTR_LEN];
     int reps = 1;
     bool ok = true, need_rand = false;
@@ -227,45 +400,29 @@ static bool queue_insert(position_t pos, int argc, char *argv[])
     error_check();
 
     if (current && exception_setup(true)) {
-        for (int r = 0; ok && r < reps; r++) {
+        if (reps > 1) {
+            ok = queue_insert_bulk(pos, inserts, need_rand, reps);
+        } else {
             if (need_rand)
                 fill_rand_string(randstr_buf, sizeof(randstr_buf));
             bool rval = pos == POS_TAIL ? q_insert_tail(current->q, inserts)
                                         : q_insert_head(current->q, inserts);
             if (rval) {
                 current->size++;
-                element_t *entry =
-                    pos == POS_TAIL
-                        ? list_last_entry(current->q, element_t, list)
-                        : list_first_entry(current->q, element_t, list);
+                element_t *entry = q_at(
+                    current->q, pos == POS_TAIL ? q_size(current->q) - 1 : 0);
                 char *cur_inserts = entry->value;
                 if (!cur_inserts) {
                     report(1, "ERROR: Failed to save copy of string in queue");
                     ok = false;
-                } else if (r == 0 && inserts == cur_inserts) {
+                } else if (inserts == cur_inserts) {
                     report(1,
                            "ERROR: Need to allocate and copy string for new "
                            "queue element");
                     ok = false;
-                    break;
-                } else if (r == 1 && lasts == cur_inserts) {
-                    report(1,
-                           "ERROR: Need to allocate separate string for each "
-                           "queue element");
-                    ok = false;
-                    break;
                 }
-                lasts = cur_inserts;
             } else {
-                fail_count++;
-                if (fail_count < fail_limit)
-                    report(2, "Insertion of %s failed", inserts);
-                else {
-                    report(1,
-                           "ERROR: Insertion of %s failed (%d failures total)",
-                           inserts, fail_count);
-                    ok = false;
-                }
+                ok = insert_failed(inserts);
             }
             ok = ok && !error_check();
         }
@@ -407,6 +564,68 @@ static bool queue_remove(position_t pos, int argc, char *argv[])
     return ok && !error_check();
 }
 
+/* Remove n elements at once and release them */
+static bool queue_remove_n(position_t pos, int argc, char *argv[])
+{
+    if (argc != 2) {
+        report(1, "%s needs 1 argument", argv[0]);
+        return false;
+    }
+
+    int n;
+    if (!get_int(argv[1], &n) || n < 1) {
+        report(1, "Invalid number of removals '%s'", argv[1]);
+        return false;
+    }
+
+    element_t **out = malloc(n * sizeof(element_t *));
+    if (!out) {
+        report(1, "INTERNAL ERROR.  Could not allocate space for %d elements",
+               n);
+        return false;
+    }
+
+    if (!current || !current->size)
+        report(3, "Warning: Calling remove %s on empty queue",
+               pos == POS_TAIL ? "tail" : "head");
+    error_check();
+
+    bool ok = true;
+    int cnt = 0;
+    int expect = current ? (current->size < n ? current->size : n) : 0;
+    if (current && exception_setup(true)) {
+        cnt = pos == POS_TAIL ? q_remove_tail_n(current->q, out, n)
+                              : q_remove_head_n(current->q, out, n);
+        if (cnt >= 0 && cnt <= n) {
+            for (int i = 0; i < cnt; i++)
+                q_release_element(out[i]);
+        }
+    }
+    exception_cancel();
+
+    if (cnt != expect) {
+        report(1, "ERROR: Removed %d elements, expected %d", cnt, expect);
+        ok = false;
+    }
+    if (cnt > 0 && cnt <= n)
+        current->size -= cnt;
+    report(2, "Removed %d elements from queue", cnt);
+
+    q_show(3);
+    free(out);
+    return ok && !error_check();
+}
+
+static bool do_rhn(int argc, char *argv[])
+{
+    return queue_remove_n(POS_HEAD, argc, argv);
+}
+
+static bool do_rtn(int argc, char *argv[])
+{
+    return queue_remove_n(POS_TAIL, argc, argv);
+}
+
 static inline bool do_rh(int argc, char *argv[])
 {
     return queue_remove(POS_HEAD, argc, argv);
@@ -433,24 +652,26 @@ static bool do_dedup(int argc, char *argv[])
     element_t *item = NULL, *tmp = NULL;
 
     // Copy current->q to l_copy
-    if (current->q && !list_empty(current->q)) {
-        list_for_each_entry (item, current->q, list) {
+    q_iter_t it;
+    if (current->q && q_size(current->q)) {
+        q_for_each_entry (item, it, current->q) {
             size_t slen;
             tmp = malloc(sizeof(element_t));
             if (!tmp)
                 break;
             INIT_LIST_HEAD(&tmp->list);
-            slen = strlen(item->value) + 1;
+            slen = strlen(q_value(item)) + 1;
             tmp->value = malloc(slen);
             if (!tmp->value) {
                 free(tmp);
                 break;
             }
-            memcpy(tmp->value, item->value, slen);
+            tmp->interned = false;
+            memcpy(tmp->value, q_value(item), slen);
             list_add_tail(&tmp->list, &l_copy);
         }
         // Return false if the loop does not leave properly
-        if (&item->list != current->q) {
+        if (item) {
             list_for_each_entry_safe (item, tmp, &l_copy, list) {
                 free(item->value);
                 free(item);
@@ -476,7 +697,8 @@ static bool do_dedup(int argc, char *argv[])
         return false;
     }
 
-    struct list_head *l_tmp = current->q->next;
+    q_iter_init(&it, current->q, 0);
+    element_t *kept = q_iter_next(&it);
     bool is_this_dup = false;
     // Compare between new list and old one
     list_for_each_entry (item, &l_copy, list) {
@@ -488,16 +710,14 @@ static bool do_dedup(int argc, char *argv[])
         if (is_this_dup || is_next_dup) {
             // Update list size
             current->size--;
-        } else if (l_tmp != current->q &&
-                   strcmp(list_entry(l_tmp, element_t, list)->value,
-                          item->value) == 0)
-            l_tmp = l_tmp->next;
+        } else if (kept && strcmp(q_value(kept), item->value) == 0)
+            kept = q_iter_next(&it);
         else
             ok = false;
         is_this_dup = is_next_dup;
     }
     // All elements in new list should be traversed
-    ok = ok && l_tmp == current->q;
+    ok = ok && !kept;
     if (!ok)
         report(1,
                "ERROR: Duplicate strings are in queue or distinct strings are "
@@ -600,12 +820,13 @@ bool do_sort(int argc, char *argv[])
  * stability of the sort. So, MAX_NODES is used to limit the number of elements
  * to check the stability of the sort. */
 #define MAX_NODES 100000
-    struct list_head *nodes[MAX_NODES];
+    element_t *nodes[MAX_NODES];
     unsigned no = 0;
     if (current && current->size && current->size <= MAX_NODES) {
         element_t *entry;
-        list_for_each_entry (entry, current->q, list)
-            nodes[no++] = &entry->list;
+        q_iter_t it;
+        q_for_each_entry (entry, it, current->q)
+            nodes[no++] = entry;
     } else if (current && current->size > MAX_NODES)
         report(1,
                "Warning: Skip checking the stability of the sort because the "
@@ -619,33 +840,32 @@ bool do_sort(int argc, char *argv[])
 
     bool ok = true;
     if (current && current->size) {
-        for (struct list_head *cur_l = current->q->next;
-             cur_l != current->q && --cnt; cur_l = cur_l->next) {
+        q_iter_t it;
+        q_iter_init(&it, current->q, 0);
+        element_t *item = q_iter_next(&it), *next_item;
+        for (; --cnt && (next_item = q_iter_next(&it)); item = next_item) {
             /* Ensure each element in ascending/descending order */
-            element_t *item, *next_item;
-            item = list_entry(cur_l, element_t, list);
-            next_item = list_entry(cur_l->next, element_t, list);
-            if (!descend && strcmp(item->value, next_item->value) > 0) {
+            if (!descend && strcmp(q_value(item), q_value(next_item)) > 0) {
                 report(1, "ERROR: Not sorted in ascending order");
                 ok = false;
                 break;
             }
 
-            if (descend && strcmp(item->value, next_item->value) < 0) {
+            if (descend && strcmp(q_value(item), q_value(next_item)) < 0) {
                 report(1, "ERROR: Not sorted in descending order");
                 ok = false;
                 break;
             }
             /* Ensure the stability of the sort */
             if (current->size <= MAX_NODES &&
-                !strcmp(item->value, next_item->value)) {
+                !strcmp(q_value(item), q_value(next_item))) {
                 bool unstable = false;
-                for (unsigned i = 0; i < MAX_NODES; i++) {
-                    if (nodes[i] == cur_l->next) {
+                for (unsigned i = 0; i < no; i++) {
+                    if (nodes[i] == next_item) {
                         unstable = true;
                         break;
                     }
-                    if (nodes[i] == cur_l) {
+                    if (nodes[i] == item) {
                         break;
                     }
                 }
@@ -654,7 +874,7 @@ bool do_sort(int argc, char *argv[])
                         1,
                         "ERROR: Not stable sort. The duplicate strings \"%s\" "
                         "are not in the same order.",
-                        item->value);
+                        q_value(item));
                     ok = false;
                     break;
                 }
@@ -747,12 +967,11 @@ static bool do_ascend(int argc, char *argv[])
 
     cnt = current->size;
     if (current->size) {
-        for (struct list_head *cur_l = current->q->next;
-             cur_l != current->q && --cnt; cur_l = cur_l->next) {
-            element_t *item, *next_item;
-            item = list_entry(cur_l, element_t, list);
-            next_item = list_entry(cur_l->next, element_t, list);
-            if (strcmp(item->value, next_item->value) > 0) {
+        q_iter_t it;
+        q_iter_init(&it, current->q, 0);
+        element_t *item = q_iter_next(&it), *next_item;
+        for (; --cnt && (next_item = q_iter_next(&it)); item = next_item) {
+            if (strcmp(q_value(item), q_value(next_item)) > 0) {
                 report(1,
                        "ERROR: At least one node violated the ordering rule");
                 ok = false;
@@ -794,12 +1013,11 @@ static bool do_descend(int argc, char *argv[])
 
     cnt = current->size;
     if (current->size) {
-        for (struct list_head *cur_l = current->q->next;
-             cur_l != current->q && --cnt; cur_l = cur_l->next) {
-            element_t *item, *next_item;
-            item = list_entry(cur_l, element_t, list);
-            next_item = list_entry(cur_l->next, element_t, list);
-            if (strcmp(item->value, next_item->value) < 0) {
+        q_iter_t it;
+        q_iter_init(&it, current->q, 0);
+        element_t *item = q_iter_next(&it), *next_item;
+        for (; --cnt && (next_item = q_iter_next(&it)); item = next_item) {
+            if (strcmp(q_value(item), q_value(next_item)) < 0) {
                 report(1,
                        "ERROR: At least one node violated the ordering rule");
                 ok = false;
@@ -855,14 +1073,22 @@ static bool do_merge(int argc, char *argv[])
     }
     error_check();
 
+    /* Merging into a queue kept in a store may grow it, and the stores of
+     * the other queues give up their memory
+     */
+    bool linked = true;
+    queue_contex_t *ctx;
+    list_for_each_entry (ctx, &chain.head, chain)
+        linked = linked && !q_head(ctx->q)->ops;
+
     int len = 0;
-    set_noallocate_mode(true);
+    set_noallocate_mode(linked);
     if (current && exception_setup(true))
         len = q_merge(&chain.head, descend);
     exception_cancel();
     set_noallocate_mode(false);
 
-    if (q_size(&chain.head) > 1) {
+    if (chain.size > 1) {
         chain.size = 1;
         current = list_entry(chain.head.next, queue_contex_t, chain);
         current->size = len;
@@ -881,13 +1107,12 @@ static bool do_merge(int argc, char *argv[])
 
     bool ok = true;
     if (current && current->size) {
-        for (struct list_head *cur_l = current->q->next;
-             cur_l != current->q && --len; cur_l = cur_l->next) {
+        q_iter_t it;
+        q_iter_init(&it, current->q, 0);
+        element_t *item = q_iter_next(&it), *next_item;
+        for (; --len && (next_item = q_iter_next(&it)); item = next_item) {
             /* Ensure each element in ascending order */
-            element_t *item, *next_item;
-            item = list_entry(cur_l, element_t, list);
-            next_item = list_entry(cur_l->next, element_t, list);
-            if (!descend && strcmp(item->value, next_item->value) > 0) {
+            if (!descend && strcmp(q_value(item), q_value(next_item)) > 0) {
                 report(1,
                        "ERROR: Not sorted in ascending order (It might because "
                        "of unsorted queues are merged or there're some flaws "
@@ -897,7 +1122,7 @@ static bool do_merge(int argc, char *argv[])
             }
 
 
-            if (descend && strcmp(item->value, next_item->value) < 0) {
+            if (descend && strcmp(q_value(item), q_value(next_item)) < 0) {
                 report(
                     1,
                     "ERROR: Not sorted in descending order (It might because "
@@ -956,24 +1181,25 @@ static bool q_show(int vlevel)
 
     report_noreturn(vlevel, "l = [");
 
-    struct list_head *ori = current->q;
-    struct list_head *cur = current->q->next;
+    q_iter_t it;
+    element_t *e = NULL;
+    bool at_end = false;
+    q_iter_init(&it, current->q, 0);
 
     if (exception_setup(true)) {
-        while (ok && ori != cur && cnt < current->size) {
-            element_t *e = list_entry(cur, element_t, list);
+        while (ok && cnt < current->size && (e = q_iter_next(&it))) {
             if (cnt < BIG_LIST_SIZE) {
-                report_noreturn(vlevel, cnt == 0 ? "%s" : " %s", e->value);
+                report_noreturn(vlevel, cnt == 0 ? "%s" : " %s", q_value(e));
                 if (show_entropy) {
                     report_noreturn(
                         vlevel, "(%3.2f%%)",
-                        shannon_entropy((const uint8_t *) e->value));
+                        shannon_entropy((const uint8_t *) q_value(e)));
                 }
             }
             cnt++;
-            cur = cur->next;
             ok = ok && !error_check();
         }
+        at_end = !e || !q_iter_next(&it);
     }
     exception_cancel();
 
@@ -982,7 +1208,7 @@ static bool q_show(int vlevel)
         return false;
     }
 
-    if (cur == ori) {
+    if (at_end) {
         if (cnt <= BIG_LIST_SIZE)
             report(vlevel, "]");
         else
@@ -1010,6 +1236,276 @@ static bool do_show(int argc, char *argv[])
     return q_show(0);
 }
 
+/* Resident set size of this process in kilobytes, or 0 if unknown */
+static size_t resident_kb()
+{
+    size_t kb = 0;
+#if defined(__linux__)
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f) {
+        unsigned long size, resident;
+        if (fscanf(f, "%lu %lu", &size, &resident) == 2)
+            kb = resident * (sysconf(_SC_PAGESIZE) / 1024);
+        fclose(f);
+    }
+#endif
+    return kb;
+}
+
+static bool do_memstat(int argc, char *argv[])
+{
+    if (argc != 1) {
+        report(1, "%s takes no arguments", argv[0]);
+        return false;
+    }
+
+    mem_stat_t stats[2];
+    const char *names[2] = {"test_malloc", "malloc_or_fail"};
+    allocation_stat(&stats[0]);
+    report_mem_stat(&stats[1]);
+
+    report(1, "%-16s %12s %14s %14s %14s", "allocator", "blocks", "bytes",
+           "peak bytes", "overhead");
+    for (int i = 0; i < 2; i++)
+        report(1, "%-16s %12zu %14zu %14zu %14zu", names[i],
+               stats[i].live_blocks, stats[i].live_bytes, stats[i].peak_bytes,
+               stats[i].overhead_bytes);
+
+    harness_stat_t held;
+    harness_stat(&held);
+    report(1, "%-16s %14s", "harness", "bytes");
+    report(1, "%-16s %14zu", "scratch", held.scratch);
+    report(1, "%-16s %14zu", "tables", held.tables);
+    report(1, "%-16s %14zu", "pool slabs", held.pool_slabs);
+
+    size_t bytes;
+    size_t strings = intern_count(&bytes);
+    if (strings || intern_mode)
+        report(1, "Interned strings: %zu (%zu bytes)", strings, bytes);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+    long peak_kb = usage.ru_maxrss / 1024;
+#else
+    long peak_kb = usage.ru_maxrss;
+#endif
+    report(1, "RSS: %zu KiB (peak %ld KiB)", resident_kb(), peak_kb);
+    return true;
+}
+
+static bool do_memprof(int argc, char *argv[])
+{
+    if (argc != 1 && argc != 2) {
+        report(1, "%s takes 0-1 arguments", argv[0]);
+        return false;
+    }
+
+    int limit = 10;
+    if (argc == 2) {
+        if (!strcmp(argv[1], "reset")) {
+            profile_reset();
+            return true;
+        }
+        if (!get_int(argv[1], &limit) || limit < 1) {
+            report(1, "Invalid number of sites '%s'", argv[1]);
+            return false;
+        }
+    }
+
+    if (!profile_mode)
+        report(1, "Warning: profiling is off, enable it with 'option profile "
+                  "1'");
+    profile_report(limit);
+    return true;
+}
+
+/* State shared by the threads of the mpmc command. The elements pushed lie
+ * sizeof(element_t) bytes apart in items, so that the offset of an element
+ * tells which one it is.
+ */
+typedef struct {
+    mpmc_t *q;
+    char *items;
+    long per_producer;
+    atomic_int producers;  /* Producers still pushing */
+    atomic_int *delivered; /* Times each element was removed */
+    atomic_long reordered; /* Elements removed before an earlier one */
+} mpmc_run_t;
+
+typedef struct {
+    mpmc_run_t *run;
+    int id;
+    long *next; /* For consumers, the next position due from each producer */
+    pthread_t thread;
+    bool started;
+} mpmc_worker_t;
+
+static void *mpmc_producer(void *arg)
+{
+    mpmc_worker_t *w = arg;
+    mpmc_run_t *run = w->run;
+    char *items = run->items + w->id * run->per_producer * sizeof(element_t);
+
+    for (long i = 0; i < run->per_producer; i++) {
+        element_t *e = (element_t *) (items + i * sizeof(element_t));
+        while (!mpmc_insert_tail(run->q, e))
+            sched_yield();
+    }
+    atomic_fetch_sub(&run->producers, 1);
+    return NULL;
+}
+
+/* Each consumer must see the elements of a producer in the order they were
+ * pushed, even though other consumers take some of them in between.
+ */
+static void *mpmc_consumer(void *arg)
+{
+    mpmc_worker_t *w = arg;
+    mpmc_run_t *run = w->run;
+
+    for (;;) {
+        /* Once every producer is done, an empty queue stays empty */
+        bool done = !atomic_load(&run->producers);
+        element_t *e = mpmc_remove_head(run->q);
+        if (!e) {
+            if (done)
+                break;
+            sched_yield();
+            continue;
+        }
+        size_t k = ((char *) e - run->items) / sizeof(element_t);
+        atomic_fetch_add_explicit(&run->delivered[k], 1,
+                                  memory_order_relaxed);
+        long p = k / run->per_producer, i = k % run->per_producer;
+        if (i < w->next[p])
+            atomic_fetch_add_explicit(&run->reordered, 1,
+                                      memory_order_relaxed);
+        w->next[p] = i + 1;
+    }
+    return NULL;
+}
+
+#define MPMC_MAX_THREADS 256
+
+static bool do_mpmc(int argc, char *argv[])
+{
+    if (argc != 4 && argc != 5) {
+        report(1, "%s takes 3-4 arguments", argv[0]);
+        return false;
+    }
+
+    int producers, consumers, per_producer, capacity = 1024;
+    if (!get_int(argv[1], &producers) || producers < 1 ||
+        producers > MPMC_MAX_THREADS) {
+        report(1, "Invalid number of producers '%s'", argv[1]);
+        return false;
+    }
+    if (!get_int(argv[2], &consumers) || consumers < 1 ||
+        consumers > MPMC_MAX_THREADS) {
+        report(1, "Invalid number of consumers '%s'", argv[2]);
+        return false;
+    }
+    if (!get_int(argv[3], &per_producer) || per_producer < 1) {
+        report(1, "Invalid number of items '%s'", argv[3]);
+        return false;
+    }
+    if (argc == 5 && (!get_int(argv[4], &capacity) || capacity < 1)) {
+        report(1, "Invalid capacity '%s'", argv[4]);
+        return false;
+    }
+
+    long total = (long) producers * per_producer;
+    mpmc_run_t run = {.per_producer = per_producer};
+    int n_workers = producers + consumers;
+    mpmc_worker_t *workers = calloc(n_workers, sizeof(mpmc_worker_t));
+    long *next = calloc((size_t) consumers * producers, sizeof(long));
+    run.items = calloc(total, sizeof(element_t));
+    run.delivered = calloc(total, sizeof(atomic_int));
+    run.q = mpmc_new(capacity);
+    if (!workers || !next || !run.items || !run.delivered || !run.q) {
+        report(1, "ERROR: Could not allocate %ld items", total);
+        free(workers);
+        free(next);
+        free(run.items);
+        free(run.delivered);
+        mpmc_free(run.q);
+        return false;
+    }
+    atomic_init(&run.producers, producers);
+    atomic_init(&run.reordered, 0);
+
+    /* Workers block signals, so the alarm of the harness reaches this one */
+    sigset_t all, old;
+    sigfillset(&all);
+    double start;
+    init_time(&start);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    for (int i = 0; i < n_workers; i++) {
+        workers[i].run = &run;
+        workers[i].id = i < producers ? i : i - producers;
+        if (i >= producers)
+            workers[i].next = next + (size_t) workers[i].id * producers;
+        workers[i].started =
+            !pthread_create(&workers[i].thread, NULL,
+                            i < producers ? mpmc_producer : mpmc_consumer,
+                            &workers[i]);
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    /* A producer which did not start leaves its items undelivered */
+    bool ok = true;
+    for (int i = 0; i < producers; i++) {
+        if (!workers[i].started) {
+            atomic_fetch_sub(&run.producers, 1);
+            ok = false;
+        }
+    }
+    int running = 0;
+    for (int i = producers; i < n_workers; i++)
+        running += workers[i].started;
+    if (!running)
+        mpmc_consumer(&workers[producers]);
+    for (int i = 0; i < n_workers; i++) {
+        if (workers[i].started)
+            pthread_join(workers[i].thread, NULL);
+    }
+    double elapsed = delta_time(&start);
+    if (!ok)
+        report(1, "ERROR: Could not start every producer");
+
+    long delivered = 0, missing = 0, duplicated = 0;
+    for (long k = 0; k < total; k++) {
+        int n = atomic_load(&run.delivered[k]);
+        delivered += n > 0;
+        missing += !n;
+        duplicated += n > 1 ? n - 1 : 0;
+    }
+    report(1, "%d producers, %d consumers: %ld items in %.3f s (%.2f M/s)",
+           producers, consumers, total, elapsed,
+           elapsed > 0 ? total / elapsed / 1e6 : 0.0);
+    if (missing || duplicated) {
+        report(1, "ERROR: %ld items delivered, %ld missing, %ld duplicated",
+               delivered, missing, duplicated);
+        ok = false;
+    } else {
+        report(1, "Every item was delivered once");
+    }
+    long reordered = atomic_load(&run.reordered);
+    if (reordered) {
+        report(1, "ERROR: %ld items overtook an earlier item of their producer",
+               reordered);
+        ok = false;
+    }
+
+    free(workers);
+    free(next);
+    free(run.items);
+    free(run.delivered);
+    mpmc_free(run.q);
+    return ok;
+}
+
 static bool do_prev(int argc, char *argv[])
 {
     if (argc != 1) {
@@ -1059,11 +1555,20 @@ static bool do_next(int argc, char *argv[])
 extern void q_shuffle(struct list_head *head);
 static bool do_shuffle(int argc, char *argv[])
 {
-    if (argc != 1) {
-        report(1, "%s takes too much arguments", argv[0]);
+    if (argc != 1 && argc != 2) {
+        report(1, "%s takes 0-1 arguments", argv[0]);
         return false;
     }
 
+    if (argc == 2) {
+        int seed;
+        if (!get_int(argv[1], &seed)) {
+            report(1, "Invalid seed '%s'", argv[1]);
+            return false;
+        }
+        prng_seed(seed);
+    }
+
     if (!current || !current->q) {
         report(3, "Warning: Calling shuffle on null queue");
         return false;
@@ -1077,8 +1582,10 @@ static bool do_shuffle(int argc, char *argv[])
         report(3, "Warning: Calling shuffle on single node");
     error_check();
 
+    set_noallocate_mode(true);
     if (exception_setup(true))
         q_shuffle(current->q);
+    exception_cancel();
     set_noallocate_mode(false);
 
     q_show(3);
@@ -1107,12 +1614,33 @@ static void console_init()
         rt,
         "Remove from tail of queue. Optionally compare to expected value str",
         "[str]");
+    ADD_COMMAND(rhn, "Remove n elements from head of queue at once", "n");
+    ADD_COMMAND(rtn, "Remove n elements from tail of queue at once", "n");
     ADD_COMMAND(reverse, "Reverse queue", "");
     ADD_COMMAND(sort, "Sort queue in ascending/descening order", "");
-    ADD_COMMAND(shuffle, "Shuffle the queue", "");
+    ADD_COMMAND(shuffle,
+                "Shuffle the queue. Reseed the generator with seed if given, "
+                "to reproduce a shuffle",
+                "[seed]");
     ADD_COMMAND(size, "Compute queue size n times (default: n == 1)", "[n]");
     ADD_COMMAND(show, "Show queue contents", "");
+    ADD_COMMAND(memstat,
+                "Show memory used by queue code and by the test program", "");
+    ADD_COMMAND(memprof,
+                "Show the n call sites that allocated the most bytes, or "
+                "clear the statistics (default: n == 10)",
+                "[n | reset]");
+    ADD_COMMAND(mpmc,
+                "Have P producer threads push K elements each through a "
+                "lock-free queue to C consumer threads, and check that "
+                "every element arrives once",
+                "P C K [capacity]");
     ADD_COMMAND(dm, "Delete middle node in queue", "");
+    ADD_COMMAND(dk, "Delete the node at position k, counting from 0", "k");
+    ADD_COMMAND(split,
+                "Move the nodes from position k on to a new queue, keeping "
+                "the current one",
+                "k");
     ADD_COMMAND(dedup, "Delete all nodes that have duplicate string", "");
     ADD_COMMAND(merge, "Merge all the queues into one sorted queue", "");
     ADD_COMMAND(swap, "Swap every two adjacent nodes in queue", "");
@@ -1130,10 +1658,38 @@ static void console_init()
               NULL);
     add_param("malloc", &fail_probability, "Malloc failure probability percent",
               NULL);
+    add_param("pool", &pool_mode, "Serve small blocks from a slab pool", NULL);
+    add_param("arena", &arena_mode,
+              "Allocate the elements of new queues from a per-queue arena",
+              NULL);
+    add_param("guard", &guard_mode,
+              "Place an inaccessible page right after every payload", NULL);
+    add_param("index", &index_mode,
+              "Reach queue positions through an order-statistic index", NULL);
+    add_param("intern", &intern_mode,
+              "Let new elements share one copy of equal strings", NULL);
+    add_param("backend", &queue_backend,
+              "Structure of new queues (0: linked list, 1: unrolled list, 2: "
+              "ring buffer)",
+              NULL);
+    add_param("mblimit", &mblimit,
+              "Maximum number of megabytes allocated (0 for no limit)", NULL);
+    add_param("profile", &profile_mode,
+              "Record allocations per call site for memprof", NULL);
+    add_param("scrub", &scrub_interval,
+              "Fill one in this many payloads on malloc/free (0 for none)",
+              NULL);
     add_param("fail", &fail_limit,
               "Number of times allow queue operations to return false", NULL);
     add_param("descend", &descend,
               "Sort and merge queue in ascending/descending order", NULL);
+    add_param("sortalgo", &sort_algo,
+              "Sort algorithm (0: bottom-up merge, 1: top-down merge, 2: "
+              "natural runs with galloping, 3: array of node pointers, 4: "
+              "MSD radix)",
+              NULL);
+    add_param("threads", &sort_threads, "Number of threads used by sort",
+              NULL);
 }
 
 /* Signal handlers */
@@ -1166,8 +1722,6 @@ static void q_init()
 static bool q_quit(int argc, char *argv[])
 {
     report(3, "Freeing queue");
-    if (current && current->size > BIG_LIST_SIZE)
-        set_cautious_mode(false);
 
     if (exception_setup(true)) {
         struct list_head *cur = chain.head.next;
@@ -1181,7 +1735,7 @@ static bool q_quit(int argc, char *argv[])
     }
 
     exception_cancel();
-    set_cautious_mode(true);
+    scratch_release();
 
     size_t bcnt = allocation_check();
     if (bcnt > 0) {
@@ -1448,6 +2002,7 @@ int main(int argc, char *argv[])
      * with the Unix time.
      */
     srand(os_random(getpid() ^ getppid()));
+    prng_seed(os_random(getpid() ^ getppid()));
 
     q_init();
     init_cmd();
@@ -1,9 +1,106 @@
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
 
+#include "backend.h"
 #include "queue.h"
+#include "random.h"
+
+/* Sorting strategy used by q_sort(), one of sort_algo_t */
+int sort_algo = SORT_LIST;
+
+/* Number of threads q_sort() may use */
+int sort_threads = 1;
+
+/* Whether positional operations go through an order-statistic index */
+int index_mode = 0;
+
+/* Whether new elements hold handles on shared interned strings */
+int intern_mode = 0;
+
+/* Backend of new queues, one of q_backend_t */
+int queue_backend = BACKEND_LIST;
+
+/* Element stores of the backends other than BACKEND_LIST */
+const q_store_ops_t *const q_stores[] = {
+    [BACKEND_UNROLLED] = &unrolled_ops,
+    [BACKEND_RING] = &ring_ops,
+};
+
+/* Natural-run merge sort parameters.
+ * MIN_GALLOP is the initial number of consecutive wins of one run after which
+ * merging switches to galloping. MAX_RUNS bounds the run stack; run lengths
+ * on the stack grow at least like the Fibonacci numbers, so 85 entries are
+ * enough for any list that fits in memory.
+ */
+#define MIN_GALLOP 7
+#define MAX_RUNS 85
+
+/* A sorted run, NULL-terminated and linked through next */
+typedef struct {
+    struct list_head *head, *tail;
+    size_t len;
+} q_run_t;
+
+/* Array sort parameters.
+ * The array is first sorted in blocks of ARRAY_RUN entries by insertion sort,
+ * then the blocks are merged bottom-up.
+ */
+#define ARRAY_RUN 16
+
+/* A node gathered for the array sort, with the leading bytes of its string */
+typedef struct {
+    uint64_t prefix;
+    struct list_head *node;
+} q_sort_entry_t;
+
+/* Radix sort parameters.
+ * Buckets of at most RADIX_CUTOFF strings are finished by insertion sort.
+ */
+#define RADIX_CUTOFF 32
+
+/* A node gathered for the radix sort, with a pointer to its string */
+typedef struct {
+    const unsigned char *s;
+    struct list_head *node;
+} q_radix_entry_t;
+
+/* Parallel sort parameters.
+ * Each thread is given at least PAR_MIN_SEGMENT nodes, and at most
+ * PAR_MAX_THREADS threads are used.
+ */
+#define PAR_MIN_SEGMENT (1 << 14)
+#define PAR_MAX_THREADS 64
+
+/* Work item of the parallel sort: sort a, or merge b into a if b is set */
+typedef struct {
+    struct list_head *a, *b;
+    bool descend;
+} q_sort_task_t;
+
+/* Order-statistic index.
+ * An implicit treap whose in-order traversal follows the queue, stored in a
+ * growable array and linked by array positions. Slot 0 stands for the empty
+ * tree. Released subtrees are pushed whole on a free list through next and
+ * taken apart one node at a time when slots are reused.
+ */
+typedef struct {
+    struct list_head *node;
+    int left, right, size;
+    int next;
+    uint32_t prio;
+} q_index_node_t;
+
+struct q_index {
+    q_index_node_t *nodes;
+    int capacity, used; /* Slots allocated, slots ever handed out */
+    int root, free;
+    uint32_t seed; /* State of the xorshift generator for priorities */
+    bool valid;    /* Whether the tree matches the queue */
+};
 
 /* Notice: sometimes, Cppcheck would find the potential NULL pointer bugs,
  * but some of them cannot occur. You can suppress them by adding the
@@ -11,33 +108,143 @@
  *   cppcheck-suppress nullPointer
  */
 
-element_t *q_new_element(char *str);
+static inline element_t *q_new_element(struct list_head *head, char *str);
+
+bool q_store_push(queue_head_t *q, element_t *e, bool tail);
+
+bool q_store_link(struct list_head *head);
+
+void q_store_unlink(struct list_head *head);
 
-void q_delete_element(struct list_head *node);
+element_t **q_store_array(struct list_head *head);
+
+void q_reverse_array(element_t **a, int n);
+
+uint64_t q_key_prefix(const char *s);
+
+void q_copy_value(const element_t *e, char *sp, size_t bufsize);
+
+void q_delete_element(struct list_head *head, struct list_head *node);
 
 int q_strncmp(const struct list_head *a, const struct list_head *b);
 
+bool q_same_value(const struct list_head *a, const struct list_head *b);
+
 void q_swap_two_node(struct list_head *l, struct list_head *r);
 
+void q_reverse_list(struct list_head *head);
+
 struct list_head *q_bubble_sort(struct list_head *head, bool descend);
 
 struct list_head *q_merge_sort(struct list_head *head, bool descend);
 
+struct list_head *q_merge_runs(struct list_head *a,
+                               struct list_head *b,
+                               bool descend);
+
+void q_merge_final(struct list_head *head,
+                   struct list_head *a,
+                   struct list_head *b,
+                   bool descend);
+
+struct list_head *q_list_sort(struct list_head *head, bool descend);
+
+struct list_head *q_find_run(struct list_head *list,
+                             q_run_t *run,
+                             bool descend);
+
+size_t q_gallop(struct list_head ***tail,
+                struct list_head **run,
+                const struct list_head *key,
+                bool strict,
+                bool descend);
+
+void q_merge_adjacent(q_run_t *x, const q_run_t *y, bool descend);
+
+struct list_head *q_tim_sort(struct list_head *head, bool descend);
+
+int q_entry_cmp(const q_sort_entry_t *a, const q_sort_entry_t *b, bool descend);
+
+struct list_head *q_array_sort(struct list_head *head, bool descend);
+
+q_sort_entry_t *q_sort_entries(q_sort_entry_t *src,
+                               q_sort_entry_t *dst,
+                               size_t n,
+                               bool descend);
+
+bool q_sort_elements(element_t **a, size_t n, bool descend);
+
+void q_radix_sort_range(q_radix_entry_t *a,
+                        q_radix_entry_t *aux,
+                        size_t n,
+                        size_t depth,
+                        bool descend);
+
+struct list_head *q_radix_sort(struct list_head *head, bool descend);
+
+void *q_sort_worker(void *arg);
+
+void q_run_tasks(q_sort_task_t *tasks, int n_tasks);
+
+bool q_parallel_sort(struct list_head *head, bool descend);
+
 struct list_head *q_merge_two_lists(struct list_head *head_a,
                                     struct list_head *head_b,
                                     bool descend);
 
+void q_merge_arenas(queue_head_t *dst, queue_head_t *src);
+
 void q_shuffle(struct list_head *head);
 
+bool q_index_reserve(struct q_index *idx, int n);
+
+int q_index_node(struct q_index *idx, struct list_head *node);
+
+void q_index_update(struct q_index *idx, int t);
+
+int q_index_join(struct q_index *idx, int a, int b);
+
+void q_index_split(struct q_index *idx, int t, int k, int *l, int *r);
+
+void q_index_sizes(struct q_index *idx, int t);
+
+struct q_index *q_index_get(struct list_head *head);
+
+void q_index_invalidate(struct list_head *head);
+
+void q_index_insert(struct list_head *head, int k, struct list_head *node);
+
+void q_index_erase(struct list_head *head, int k);
+
+void q_index_cut(struct list_head *head, int k, bool keep_front);
+
+struct list_head *q_node_at(struct list_head *head, int k);
+
 /* Create an empty queue */
 struct list_head *q_new()
 {
-    struct list_head *q_head =
-        (struct list_head *) malloc(sizeof(struct list_head));
-    if (!q_head)
+    queue_head_t *q = (queue_head_t *) malloc(sizeof(queue_head_t));
+    if (!q)
         return NULL;
-    INIT_LIST_HEAD(q_head);
-    return q_head;
+    INIT_LIST_HEAD(&q->head);
+    q->size = 0;
+    q->arena = test_arena_new();
+    q->foreign = false;
+    q->index = NULL;
+    q->ops = NULL;
+    q->store = NULL;
+
+    int n_stores = sizeof(q_stores) / sizeof(q_stores[0]);
+    if (queue_backend > BACKEND_LIST && queue_backend < n_stores) {
+        q->ops = q_stores[queue_backend];
+        q->store = q->ops->create();
+        if (!q->store) {
+            test_arena_release(q->arena);
+            free(q);
+            return NULL;
+        }
+    }
+    return &q->head;
 }
 
 /* Free all storage used by queue */
@@ -46,42 +253,154 @@ void q_free(struct list_head *head)
     if (!head)
         return;
 
-    element_t *entry = NULL, *safe = NULL;
-    list_for_each_entry_safe (entry, safe, head, list) {
-        list_del_init(&entry->list);
-        q_release_element(entry);
+    /* When every element lives in an arena of its own, release them all
+     * together. Interned strings need their references dropped one by one.
+     */
+    queue_head_t *q = q_head(head);
+    if (!q->arena || q->foreign || test_arena_shared(q->arena) ||
+        intern_count(NULL)) {
+        element_t *entry = NULL, *safe = NULL;
+        if (q->ops) {
+            while ((entry = q->ops->pop(q->store, false)))
+                q_release_element(entry);
+        }
+        list_for_each_entry_safe (entry, safe, head, list) {
+            list_del_init(&entry->list);
+            q_release_element(entry);
+        }
     }
-    free(head);
+    if (q->index) {
+        free(q->index->nodes);
+        free(q->index);
+    }
+    if (q->ops)
+        q->ops->destroy(q->store);
+    test_arena_release(q->arena);
+    free(q);
 }
 
-element_t *q_new_element(char *str)
+/*
+ * Pack the first eight bytes of s into an integer, big-endian and padded with
+ * zeros, so that comparing prefixes agrees with strcmp() whenever they differ.
+ */
+uint64_t q_key_prefix(const char *s)
 {
-    element_t *new_node = (element_t *) malloc(sizeof(element_t));
-    if (!new_node)
-        return NULL;
+    uint64_t prefix = 0;
+    for (int i = 0; i < 8; i++) {
+        prefix <<= 8;
+        if (*s)
+            prefix |= (unsigned char) *s++;
+    }
+    return prefix;
+}
 
-    new_node->value = (char *) malloc(strlen(str) + 1);
-    if (!new_node->value) {
-        free(new_node);
+/*
+ * Allocate an element for str. With intern_mode set, @data only holds a
+ * handle on an interned copy, otherwise the element holds its own copy. It is
+ * inlined so that the allocation profiler charges the insertion function
+ * which called it.
+ */
+static inline element_t *q_new_element(struct list_head *head, char *str)
+{
+    size_t len = strlen(str);
+    char *shared = NULL;
+    if (intern_mode) {
+        shared = intern_get(str, len);
+        if (!shared)
+            return NULL;
+    }
+
+    element_t *new_node = (element_t *) test_arena_alloc(
+        q_head(head)->arena,
+        sizeof(element_t) + (shared ? sizeof(shared) : len + 1));
+    if (!new_node) {
+        if (shared)
+            intern_put(shared);
         return NULL;
     }
 
-    strncpy(new_node->value, str, strlen(str) + 1);
+    if (shared)
+        memcpy(new_node->data, &shared, sizeof(shared));
+    else
+        memcpy(new_node->data, str, len + 1);
+    new_node->value = new_node->data;
+    new_node->interned = shared;
+    new_node->len = len;
+    new_node->prefix = q_key_prefix(str);
     return new_node;
 }
 
+/* Add e at an end of a queue kept in a store, or release it if out of memory */
+bool q_store_push(queue_head_t *q, element_t *e, bool tail)
+{
+    if (!q->ops->push(q->store, e, tail)) {
+        q_release_element(e);
+        return false;
+    }
+    q->size++;
+    return true;
+}
+
+/*
+ * Link the elements of a queue kept in a store through its head, so that the
+ * list algorithms can rearrange them. Return false, leaving the queue alone,
+ * if it is kept in a list, is empty or is linked already.
+ */
+bool q_store_link(struct list_head *head)
+{
+    if (!head)
+        return false;
+
+    queue_head_t *q = q_head(head);
+    if (!q->ops || !q->size || !list_empty(head))
+        return false;
+
+    q_iter_t it;
+    element_t *entry;
+    q_for_each_entry (entry, it, head)
+        list_add_tail(&entry->list, head);
+    return true;
+}
+
+/* Return the elements of a queue as the array its store keeps them in, or
+ * NULL if the queue is kept in a list or a store without such an array
+ */
+element_t **q_store_array(struct list_head *head)
+{
+    if (!head)
+        return NULL;
+
+    queue_head_t *q = q_head(head);
+    if (!q->ops || !q->ops->view)
+        return NULL;
+    return q->ops->view(q->store);
+}
+
+/* Hand the elements linked through head back to the store, in their order */
+void q_store_unlink(struct list_head *head)
+{
+    queue_head_t *q = q_head(head);
+    q->ops->refill(q->store, head, q->size);
+    INIT_LIST_HEAD(head);
+}
+
 /* Insert an element at head of queue */
 bool q_insert_head(struct list_head *head, char *s)
 {
     if (!head)
         return false;
 
-    element_t *new_node = q_new_element(s);
+    element_t *new_node = q_new_element(head, s);
 
     if (!new_node)
         return false;
 
+    if (q_head(head)->ops)
+        return q_store_push(q_head(head), new_node, false);
+
     list_add(&new_node->list, head);
+    q_head(head)->size++;
+    q_index_insert(head, 0, &new_node->list);
     return true;
 }
 
@@ -91,45 +410,218 @@ bool q_insert_tail(struct list_head *head, char *s)
     if (!head)
         return false;
 
-    element_t *new_node = q_new_element(s);
+    element_t *new_node = q_new_element(head, s);
 
     if (!new_node)
         return false;
 
+    if (q_head(head)->ops)
+        return q_store_push(q_head(head), new_node, true);
+
     list_add_tail(&new_node->list, head);
+    q_head(head)->size++;
+    q_index_insert(head, q_head(head)->size - 1, &new_node->list);
     return true;
 }
 
+/* Insert elements at head of queue */
+int q_insert_head_bulk(struct list_head *head, char **strs, int n)
+{
+    if (!head)
+        return 0;
+
+    int i;
+    queue_head_t *q = q_head(head);
+    if (q->ops) {
+        for (i = 0; i < n; i++) {
+            element_t *new_node = q_new_element(head, strs[i]);
+            if (!new_node || !q_store_push(q, new_node, false))
+                break;
+        }
+        return i;
+    }
+
+    LIST_HEAD(chain);
+    for (i = 0; i < n; i++) {
+        element_t *new_node = q_new_element(head, strs[i]);
+        if (!new_node)
+            break;
+        list_add(&new_node->list, &chain);
+    }
+
+    list_splice(&chain, head);
+    q->size += i;
+    q_index_invalidate(head);
+    return i;
+}
+
+/* Insert elements at tail of queue */
+int q_insert_tail_bulk(struct list_head *head, char **strs, int n)
+{
+    if (!head)
+        return 0;
+
+    int i;
+    queue_head_t *q = q_head(head);
+    if (q->ops) {
+        for (i = 0; i < n; i++) {
+            element_t *new_node = q_new_element(head, strs[i]);
+            if (!new_node || !q_store_push(q, new_node, true))
+                break;
+        }
+        return i;
+    }
+
+    LIST_HEAD(chain);
+    for (i = 0; i < n; i++) {
+        element_t *new_node = q_new_element(head, strs[i]);
+        if (!new_node)
+            break;
+        list_add_tail(&new_node->list, &chain);
+    }
+
+    list_splice_tail(&chain, head);
+    q->size += i;
+    q_index_invalidate(head);
+    return i;
+}
+
 /* Remove an element from head of queue */
 element_t *q_remove_head(struct list_head *head, char *sp, size_t bufsize)
 {
-    if (!head || list_empty(head))
+    element_t *ptr = q_detach_head(head);
+    if (ptr)
+        q_copy_value(ptr, sp, bufsize);
+    return ptr;
+}
+
+/* Remove an element from tail of queue */
+element_t *q_remove_tail(struct list_head *head, char *sp, size_t bufsize)
+{
+    element_t *ptr = q_detach_tail(head);
+    if (ptr)
+        q_copy_value(ptr, sp, bufsize);
+    return ptr;
+}
+
+/* Unlink the element at head of queue without copying its string */
+element_t *q_detach_head(struct list_head *head)
+{
+    if (!head || !q_size(head))
         return NULL;
 
-    element_t *ptr = list_first_entry(head, element_t, list);
-    list_del_init(&ptr->list);
-    if (sp) {
-        strncpy(sp, ptr->value, bufsize - 1);
-        sp[bufsize - 1] = '\0';
+    queue_head_t *q = q_head(head);
+    if (q->ops) {
+        q->size--;
+        return q->ops->pop(q->store, false);
     }
 
+    element_t *ptr = list_first_entry(head, element_t, list);
+    list_del_init(&ptr->list);
+    q->size--;
+    q_index_erase(head, 0);
     return ptr;
 }
 
-/* Remove an element from tail of queue */
-element_t *q_remove_tail(struct list_head *head, char *sp, size_t bufsize)
+/* Unlink the element at tail of queue without copying its string */
+element_t *q_detach_tail(struct list_head *head)
 {
-    if (!head || list_empty(head))
+    if (!head || !q_size(head))
         return NULL;
 
+    queue_head_t *q = q_head(head);
+    if (q->ops) {
+        q->size--;
+        return q->ops->pop(q->store, true);
+    }
+
     element_t *ptr = list_last_entry(head, element_t, list);
     list_del_init(&ptr->list);
-    if (sp) {
-        strncpy(sp, ptr->value, bufsize - 1);
-        sp[bufsize - 1] = '\0';
+    q->size--;
+    q_index_erase(head, q->size);
+    return ptr;
+}
+
+/* Unlink up to n elements from head of queue into out */
+int q_remove_head_n(struct list_head *head, element_t **out, int n)
+{
+    if (!head || n <= 0 || !q_size(head))
+        return 0;
+
+    int size = q_size(head);
+    if (n > size)
+        n = size;
+
+    queue_head_t *q = q_head(head);
+    if (q->ops) {
+        for (int i = 0; i < n; i++)
+            out[i] = q->ops->pop(q->store, false);
+        q->size -= n;
+        return n;
     }
 
-    return ptr;
+    struct list_head *last = head;
+    for (int i = 0; i < n; i++) {
+        last = last->next;
+        out[i] = list_entry(last, element_t, list);
+    }
+
+    LIST_HEAD(batch);
+    list_cut_position(&batch, head, last);
+    q->size -= n;
+    q_index_cut(head, n, false);
+    for (int i = 0; i < n; i++)
+        INIT_LIST_HEAD(&out[i]->list);
+    return n;
+}
+
+/* Unlink up to n elements from tail of queue into out, last one first */
+int q_remove_tail_n(struct list_head *head, element_t **out, int n)
+{
+    if (!head || n <= 0 || !q_size(head))
+        return 0;
+
+    int size = q_size(head);
+    if (n > size)
+        n = size;
+
+    queue_head_t *q = q_head(head);
+    if (q->ops) {
+        for (int i = 0; i < n; i++)
+            out[i] = q->ops->pop(q->store, true);
+        q->size -= n;
+        return n;
+    }
+
+    struct list_head *first = head;
+    for (int i = 0; i < n; i++) {
+        first = first->prev;
+        out[i] = list_entry(first, element_t, list);
+    }
+
+    /* Unlink the whole run from first to the tail at once */
+    struct list_head *prev = first->prev;
+    prev->next = head;
+    head->prev = prev;
+    q->size -= n;
+    q_index_cut(head, size - n, true);
+    for (int i = 0; i < n; i++)
+        INIT_LIST_HEAD(&out[i]->list);
+    return n;
+}
+
+/*
+ * Copy the string of e into sp, truncated to bufsize - 1 characters. Only the
+ * string itself and its terminator are written, not the rest of the buffer.
+ */
+void q_copy_value(const element_t *e, char *sp, size_t bufsize)
+{
+    if (!sp || !bufsize)
+        return;
+
+    size_t len = e->len < bufsize - 1 ? e->len : bufsize - 1;
+    memcpy(sp, q_value(e), len);
+    sp[len] = '\0';
 }
 
 /* Return number of elements in queue */
@@ -138,52 +630,441 @@ int q_size(struct list_head *head)
     if (!head)
         return 0;
 
-    int len = 0;
-    struct list_head *li;
+    return q_head(head)->size;
+}
+
+/* Start a walk over the elements of a queue at position k */
+void q_iter_init(q_iter_t *it, struct list_head *head, int k)
+{
+    it->head = head;
+    it->node = head;
+    it->pos = 0;
+    if (!head)
+        return;
+
+    queue_head_t *q = q_head(head);
+    if (q->ops) {
+        q->ops->seek(q->store, it, k);
+        return;
+    }
 
-    list_for_each (li, head)
-        len++;
-    return len;
+    /* Stop at the node in front of position k, walking from the nearer end */
+    struct list_head *node = head;
+    if (k > q->size)
+        k = q->size;
+    if (k < q->size / 2) {
+        for (int i = 0; i < k; i++)
+            node = node->next;
+    } else {
+        for (int i = q->size; i >= k; i--)
+            node = node->prev;
+    }
+    it->node = node;
 }
 
-void q_delete_element(struct list_head *node)
+/* Return the next element of a walk over a queue */
+element_t *q_iter_next(q_iter_t *it)
+{
+    if (!it->head)
+        return NULL;
+
+    queue_head_t *q = q_head(it->head);
+    if (q->ops)
+        return q->ops->next(q->store, it);
+
+    struct list_head *node = ((struct list_head *) it->node)->next;
+    if (node == it->head)
+        return NULL;
+    it->node = node;
+    return list_entry(node, element_t, list);
+}
+
+void q_delete_element(struct list_head *head, struct list_head *node)
 {
     element_t *element = list_entry(node, element_t, list);
     list_del_init(&element->list);
     q_release_element(element);
+    q_head(head)->size--;
+    q_index_invalidate(head);
+}
+
+/* Make room for n nodes besides the empty tree */
+bool q_index_reserve(struct q_index *idx, int n)
+{
+    if (n < idx->capacity)
+        return true;
+
+    int capacity = idx->capacity ? idx->capacity : 64;
+    while (capacity <= n)
+        capacity *= 2;
+    q_index_node_t *nodes =
+        realloc(idx->nodes, (size_t) capacity * sizeof(q_index_node_t));
+    if (!nodes)
+        return false;
+    idx->nodes = nodes;
+    idx->capacity = capacity;
+    return true;
+}
+
+/* Take a free slot for node, or return 0 if none can be had */
+int q_index_node(struct q_index *idx, struct list_head *node)
+{
+    int t = idx->free;
+    if (t) {
+        /* Give the children of the reused slot their own free list entries */
+        q_index_node_t *n = idx->nodes;
+        idx->free = n[t].next;
+        if (n[t].left) {
+            n[n[t].left].next = idx->free;
+            idx->free = n[t].left;
+        }
+        if (n[t].right) {
+            n[n[t].right].next = idx->free;
+            idx->free = n[t].right;
+        }
+    } else {
+        if (!q_index_reserve(idx, idx->used))
+            return 0;
+        t = idx->used++;
+    }
+
+    idx->seed ^= idx->seed << 13;
+    idx->seed ^= idx->seed >> 17;
+    idx->seed ^= idx->seed << 5;
+    idx->nodes[t] = (q_index_node_t){
+        .node = node, .left = 0, .right = 0, .size = 1, .prio = idx->seed};
+    return t;
+}
+
+void q_index_update(struct q_index *idx, int t)
+{
+    q_index_node_t *n = idx->nodes;
+    n[t].size = n[n[t].left].size + 1 + n[n[t].right].size;
+}
+
+/* Concatenate the trees a and b */
+int q_index_join(struct q_index *idx, int a, int b)
+{
+    q_index_node_t *n = idx->nodes;
+    if (!a || !b)
+        return a ? a : b;
+
+    if (n[a].prio > n[b].prio) {
+        n[a].right = q_index_join(idx, n[a].right, b);
+        q_index_update(idx, a);
+        return a;
+    }
+    n[b].left = q_index_join(idx, a, n[b].left);
+    q_index_update(idx, b);
+    return b;
+}
+
+/* Split tree t into its first k nodes, l, and the others, r */
+void q_index_split(struct q_index *idx, int t, int k, int *l, int *r)
+{
+    q_index_node_t *n = idx->nodes;
+    if (!t) {
+        *l = *r = 0;
+        return;
+    }
+
+    if (n[n[t].left].size < k) {
+        q_index_split(idx, n[t].right, k - n[n[t].left].size - 1,
+                      &n[t].right, r);
+        *l = t;
+    } else {
+        q_index_split(idx, n[t].left, k, l, &n[t].left);
+        *r = t;
+    }
+    q_index_update(idx, t);
+}
+
+/* Fill in the sizes of tree t after it was built */
+void q_index_sizes(struct q_index *idx, int t)
+{
+    if (!t)
+        return;
+    q_index_sizes(idx, idx->nodes[t].left);
+    q_index_sizes(idx, idx->nodes[t].right);
+    q_index_update(idx, t);
+}
+
+/*
+ * Return the index of the queue, rebuilding it in linear time if it is stale,
+ * or NULL if indexing is off or there is no memory for it. The tree is built
+ * as a Cartesian tree, keeping its right spine on a stack linked through next.
+ */
+struct q_index *q_index_get(struct list_head *head)
+{
+    queue_head_t *q = q_head(head);
+    if (q->index && q->index->valid)
+        return q->index;
+    if (!index_mode || q->ops)
+        return NULL;
+
+    if (!q->index) {
+        q->index = calloc(1, sizeof(struct q_index));
+        if (!q->index)
+            return NULL;
+        q->index->seed = 2463534242U;
+    }
+
+    struct q_index *idx = q->index;
+    if (!q_index_reserve(idx, q->size))
+        return NULL;
+    idx->used = 1;
+    idx->free = 0;
+    idx->nodes[0] = (q_index_node_t){0};
+
+    q_index_node_t *n = idx->nodes;
+    int top = 0;
+    struct list_head *node;
+    list_for_each (node, head) {
+        int t = q_index_node(idx, node), last = 0;
+        while (top && n[top].prio < n[t].prio) {
+            last = top;
+            top = n[top].next;
+        }
+        n[t].left = last;
+        if (top)
+            n[top].right = t;
+        n[t].next = top;
+        top = t;
+    }
+
+    idx->root = 0;
+    for (; top; top = n[top].next)
+        idx->root = top;
+    q_index_sizes(idx, idx->root);
+    idx->valid = true;
+    return idx;
+}
+
+/* Mark the index stale after the queue was rearranged */
+void q_index_invalidate(struct list_head *head)
+{
+    queue_head_t *q = q_head(head);
+    if (q->index)
+        q->index->valid = false;
+}
+
+/* Record that node was inserted at position k */
+void q_index_insert(struct list_head *head, int k, struct list_head *node)
+{
+    struct q_index *idx = q_head(head)->index;
+    if (!idx || !idx->valid)
+        return;
+
+    int t = q_index_node(idx, node);
+    if (!t) {
+        idx->valid = false;
+        return;
+    }
+    int l, r;
+    q_index_split(idx, idx->root, k, &l, &r);
+    idx->root = q_index_join(idx, q_index_join(idx, l, t), r);
+}
+
+/* Record that the node at position k was removed */
+void q_index_erase(struct list_head *head, int k)
+{
+    struct q_index *idx = q_head(head)->index;
+    if (!idx || !idx->valid)
+        return;
+
+    int l, m, r;
+    q_index_split(idx, idx->root, k, &l, &m);
+    q_index_split(idx, m, 1, &m, &r);
+    idx->nodes[m].next = idx->free;
+    idx->free = m;
+    idx->root = q_index_join(idx, l, r);
+}
+
+/* Record that the queue was cut at position k, keeping the nodes in front of
+ * it if keep_front is set and those behind it otherwise.
+ */
+void q_index_cut(struct list_head *head, int k, bool keep_front)
+{
+    struct q_index *idx = q_head(head)->index;
+    if (!idx || !idx->valid)
+        return;
+
+    int l, r;
+    q_index_split(idx, idx->root, k, &l, &r);
+    int gone = keep_front ? r : l;
+    idx->root = keep_front ? l : r;
+    if (gone) {
+        idx->nodes[gone].next = idx->free;
+        idx->free = gone;
+    }
+}
+
+/* Find the node at position k, which must be in range */
+struct list_head *q_node_at(struct list_head *head, int k)
+{
+    struct q_index *idx = q_index_get(head);
+    if (idx) {
+        q_index_node_t *n = idx->nodes;
+        int t = idx->root;
+        for (;;) {
+            int left = n[n[t].left].size;
+            if (k == left)
+                return n[t].node;
+            if (k < left) {
+                t = n[t].left;
+            } else {
+                k -= left + 1;
+                t = n[t].right;
+            }
+        }
+    }
+
+    /* Walk from the nearer end */
+    int size = q_size(head);
+    struct list_head *node = head;
+    if (k < size / 2) {
+        for (int i = 0; i <= k; i++)
+            node = node->next;
+    } else {
+        for (int i = size; i > k; i--)
+            node = node->prev;
+    }
+    return node;
+}
+
+/* Return the element at position k */
+element_t *q_at(struct list_head *head, int k)
+{
+    if (!head || k < 0 || k >= q_size(head))
+        return NULL;
+
+    queue_head_t *q = q_head(head);
+    if (q->ops)
+        return q->ops->at(q->store, k);
+    return list_entry(q_node_at(head, k), element_t, list);
+}
+
+/* Delete the element at position k */
+bool q_delete_at(struct list_head *head, int k)
+{
+    if (!head || k < 0 || k >= q_size(head))
+        return false;
+
+    queue_head_t *q = q_head(head);
+    if (q->ops) {
+        q_release_element(q->ops->erase(q->store, k));
+        q->size--;
+        return true;
+    }
+
+    element_t *element = list_entry(q_node_at(head, k), element_t, list);
+    list_del_init(&element->list);
+    q_release_element(element);
+    q->size--;
+    q_index_erase(head, k);
+    return true;
+}
+
+/* Move the elements from position k on to the empty queue rest */
+int q_split(struct list_head *head, struct list_head *rest, int k)
+{
+    if (!head || !rest || q_size(rest) || k < 0 || k >= q_size(head))
+        return 0;
+
+    queue_head_t *q = q_head(head), *r = q_head(rest);
+    if (r->ops && !r->ops->reserve(r->store, q->size - k))
+        return 0;
+
+    /* rest is about to hold elements from the arena of head */
+    if (q->arena) {
+        test_arena_t *shared = test_arena_share(q->arena);
+        if (!shared)
+            return 0;
+        test_arena_release(r->arena);
+        r->arena = shared;
+        r->foreign = q->foreign;
+    } else {
+        r->foreign = r->arena != NULL;
+    }
+
+    bool linked = q_store_link(head);
+    int moved = q->size - k;
+    if (k == 0) {
+        list_splice_tail_init(head, rest);
+    } else {
+        LIST_HEAD(front);
+        list_cut_position(&front, head, q_node_at(head, k - 1));
+        list_splice_tail_init(head, rest);
+        list_splice(&front, head);
+    }
+    q->size = k;
+    r->size = moved;
+    q_index_cut(head, k, true);
+    q_index_invalidate(rest);
+    if (linked)
+        q_store_unlink(head);
+    if (r->ops)
+        q_store_unlink(rest);
+    return moved;
 }
 
 /* Delete the middle node in queue */
 bool q_delete_mid(struct list_head *head)
 {
     // https://leetcode.com/problems/delete-the-middle-node-of-a-linked-list/
-    if (!head || list_empty(head))
+    if (!head || !q_size(head))
         return false;
 
-    struct list_head *slow_mid = head->next;
-    for (const struct list_head *fast = head->next;
-         fast != head && fast->next != head; fast = fast->next->next) {
-        slow_mid = slow_mid->next;
-    }
-    q_delete_element(slow_mid);
-
-    return true;
+    return q_delete_at(head, q_size(head) / 2);
 }
 
+/*
+ * Compare the strings of two elements like strcmp(). The cached prefixes
+ * settle most comparisons. When they tie and either string ends inside its
+ * prefix, or both share one interned copy, the strings are equal; otherwise
+ * compare the rest up to and including the terminator of the shorter one.
+ */
 int q_strncmp(const struct list_head *a, const struct list_head *b)
 {
     const element_t *e_a = list_entry(a, element_t, list);
     const element_t *e_b = list_entry(b, element_t, list);
-    int len_a = strlen(e_a->value);
-    int len_b = strlen(e_b->value);
-    int n = len_a > len_b ? len_a + 1 : len_b + 1;
-    return strncmp(e_a->value, e_b->value, n);
+
+    if (e_a->prefix != e_b->prefix)
+        return e_a->prefix < e_b->prefix ? -1 : 1;
+
+    size_t len = e_a->len < e_b->len ? e_a->len : e_b->len;
+    const char *s_a = q_value(e_a), *s_b = q_value(e_b);
+    if (len < sizeof(e_a->prefix) || s_a == s_b)
+        return 0;
+    return memcmp(s_a + sizeof(e_a->prefix), s_b + sizeof(e_b->prefix),
+                  len + 1 - sizeof(e_a->prefix));
+}
+
+/*
+ * Return whether two elements hold equal strings. Interned strings are equal
+ * exactly when their handles point at the same copy, so two of them are told
+ * apart without reading the strings.
+ */
+bool q_same_value(const struct list_head *a, const struct list_head *b)
+{
+    const element_t *e_a = list_entry(a, element_t, list);
+    const element_t *e_b = list_entry(b, element_t, list);
+
+    if (e_a->interned && e_b->interned)
+        return q_value(e_a) == q_value(e_b);
+    return !q_strncmp(a, b);
 }
 
 /* Delete all nodes that have duplicate string */
 bool q_delete_dup(struct list_head *head)
 {
     // https://leetcode.com/problems/remove-duplicates-from-sorted-list-ii/
+    if (q_store_link(head)) {
+        bool ok = q_delete_dup(head);
+        q_store_unlink(head);
+        return ok;
+    }
+
     if (!head || list_empty(head))
         return false;
 
@@ -201,7 +1082,7 @@ bool q_delete_dup(struct list_head *head)
     struct list_head *from = head->next, *to = head->next->next;
 
     while (from != head && to != head) {
-        while (to != head && !q_strncmp(from, to)) {
+        while (to != head && q_same_value(from, to)) {
             delete = true;
             to = to->next;
         }
@@ -210,7 +1091,7 @@ bool q_delete_dup(struct list_head *head)
             struct list_head *tmp = from;
             while (from != to) {
                 from = from->next;
-                q_delete_element(tmp);
+                q_delete_element(head, tmp);
                 tmp = from;
             }
         }
@@ -262,9 +1143,38 @@ void q_swap_two_node(struct list_head *l, struct list_head *r)
 /* Reverse elements in queue */
 void q_reverse(struct list_head *head)
 {
+    element_t **a = q_store_array(head);
+    if (a) {
+        q_reverse_array(a, q_size(head));
+        return;
+    }
+
+    if (q_store_link(head)) {
+        q_reverse(head);
+        q_store_unlink(head);
+        return;
+    }
+
     if (!head || list_empty(head) || list_is_singular(head))
         return;
 
+    q_index_invalidate(head);
+    q_reverse_list(head);
+}
+
+/* Reverse the n element pointers of a */
+void q_reverse_array(element_t **a, int n)
+{
+    for (int i = 0, j = n - 1; i < j; i++, j--) {
+        element_t *tmp = a[i];
+        a[i] = a[j];
+        a[j] = tmp;
+    }
+}
+
+/* Reverse the nodes of a list, which need not be the head of a queue */
+void q_reverse_list(struct list_head *head)
+{
     struct list_head *entry = NULL, *safe = NULL;
     list_for_each_safe (entry, safe, head) {
         entry->next = entry->prev;
@@ -278,9 +1188,24 @@ void q_reverse(struct list_head *head)
 void q_reverseK(struct list_head *head, int k)
 {
     // https://leetcode.com/problems/reverse-nodes-in-k-group/
+    element_t **a = q_store_array(head);
+    if (a) {
+        int n = q_size(head);
+        for (int i = 0; k > 1 && i + k <= n; i += k)
+            q_reverse_array(a + i, k);
+        return;
+    }
+
+    if (q_store_link(head)) {
+        q_reverseK(head, k);
+        q_store_unlink(head);
+        return;
+    }
+
     if (!head || list_empty(head) || list_is_singular(head) || k == 1)
         return;
 
+    q_index_invalidate(head);
     struct list_head tmp_list, *tmp_head = &tmp_list;
     struct list_head reverse_list, *reverse_head = &reverse_list;
     struct list_head *ptr = head->next;
@@ -294,7 +1219,7 @@ void q_reverseK(struct list_head *head, int k)
         }
         if (i == k) {
             list_cut_position(tmp_head, head, ptr->prev);
-            q_reverse(tmp_head);
+            q_reverse_list(tmp_head);
             list_splice_tail_init(tmp_head, reverse_head);
         }
     }
@@ -338,20 +1263,750 @@ struct list_head *q_merge_sort(struct list_head *head, bool descend)
     return q_merge_two_lists(left, right, descend);
 }
 
+/*
+ * Merge two NULL-terminated runs linked through their next pointers. Nodes of
+ * a are taken first on ties, so a must be the run that came earlier in the
+ * list to keep the sort stable. The prev pointers are left untouched.
+ */
+struct list_head *q_merge_runs(struct list_head *a,
+                               struct list_head *b,
+                               bool descend)
+{
+    struct list_head *head = NULL, **tail = &head;
+
+    for (;;) {
+        int cmp = q_strncmp(a, b);
+        if ((descend ? -cmp : cmp) <= 0) {
+            *tail = a;
+            tail = &a->next;
+            a = a->next;
+            if (!a) {
+                *tail = b;
+                break;
+            }
+        } else {
+            *tail = b;
+            tail = &b->next;
+            b = b->next;
+            if (!b) {
+                *tail = a;
+                break;
+            }
+        }
+    }
+    return head;
+}
+
+/*
+ * Same as q_merge_runs(), but splice the result back into the circular list
+ * at head and restore the prev pointers on the way.
+ */
+void q_merge_final(struct list_head *head,
+                   struct list_head *a,
+                   struct list_head *b,
+                   bool descend)
+{
+    struct list_head *tail = head;
+
+    for (;;) {
+        int cmp = q_strncmp(a, b);
+        if ((descend ? -cmp : cmp) <= 0) {
+            tail->next = a;
+            a->prev = tail;
+            tail = a;
+            a = a->next;
+            if (!a)
+                break;
+        } else {
+            tail->next = b;
+            b->prev = tail;
+            tail = b;
+            b = b->next;
+            if (!b) {
+                b = a;
+                break;
+            }
+        }
+    }
+
+    /* Finish linking the remainder of the list */
+    do {
+        tail->next = b;
+        b->prev = tail;
+        tail = b;
+        b = b->next;
+    } while (b);
+
+    tail->next = head;
+    head->prev = tail;
+}
+
+/*
+ * Bottom-up merge sort, following list_sort() of the Linux kernel.
+ *
+ * Nodes are moved one by one onto a stack of pending runs. The runs are
+ * singly linked through next, and the stack itself is linked through the prev
+ * pointer of each run's first node. Whenever the count of moved nodes reaches
+ * a point where two pending runs of the same power-of-two size exist below a
+ * smaller one, those two are merged, which keeps the merges balanced at 2:1
+ * without ever walking the list to find a midpoint. The prev pointers are
+ * rebuilt while merging the last two runs.
+ */
+struct list_head *q_list_sort(struct list_head *head, bool descend)
+{
+    struct list_head *list = head->next, *pending = NULL;
+    size_t count = 0;
+
+    /* Break the circle, the last node now ends the input */
+    head->prev->next = NULL;
+
+    do {
+        size_t bits;
+        struct list_head **tail = &pending;
+
+        /* Find the least-significant clear bit in count */
+        for (bits = count; bits & 1; bits >>= 1)
+            tail = &(*tail)->prev;
+        /* Do the indicated merge, unless count is one less than a power of 2 */
+        if (bits) {
+            struct list_head *a = *tail, *b = a->prev;
+
+            a = q_merge_runs(b, a, descend);
+            a->prev = b->prev;
+            *tail = a;
+        }
+
+        /* Move one element from the input to the pending stack */
+        list->prev = pending;
+        pending = list;
+        list = list->next;
+        pending->next = NULL;
+        count++;
+    } while (list);
+
+    /* Merge all remaining pending runs, newest first */
+    list = pending;
+    pending = pending->prev;
+    for (;;) {
+        struct list_head *next = pending->prev;
+
+        if (!next)
+            break;
+        list = q_merge_runs(pending, list, descend);
+        pending = next;
+    }
+    q_merge_final(head, pending, list, descend);
+    return head;
+}
+
+/*
+ * Cut the natural run starting at list off the input and describe it in run.
+ * A strictly descending run is reversed in place, which keeps equal elements
+ * in order since it cannot contain any. Return the rest of the input.
+ */
+struct list_head *q_find_run(struct list_head *list, q_run_t *run, bool descend)
+{
+    struct list_head *cur = list, *next = list->next;
+    size_t len = 1;
+
+    if (!next) {
+        run->head = run->tail = list;
+        run->len = 1;
+        return NULL;
+    }
+
+    int cmp = q_strncmp(cur, next);
+    if ((descend ? -cmp : cmp) <= 0) {
+        do {
+            cur = next;
+            next = next->next;
+            len++;
+            if (!next)
+                break;
+            cmp = q_strncmp(cur, next);
+        } while ((descend ? -cmp : cmp) <= 0);
+        cur->next = NULL;
+        run->head = list;
+        run->tail = cur;
+    } else {
+        /* Reverse the strictly descending run while walking it */
+        struct list_head *rev = NULL;
+        for (;;) {
+            cur->next = rev;
+            rev = cur;
+            cur = next;
+            len++;
+            next = next->next;
+            if (!next)
+                break;
+            cmp = q_strncmp(cur, next);
+            if ((descend ? -cmp : cmp) <= 0)
+                break;
+        }
+        cur->next = rev;
+        run->head = cur;
+        run->tail = list;
+    }
+    run->len = len;
+    return next;
+}
+
+/*
+ * Move the leading nodes of *run which belong before key to **tail, probing at
+ * exponentially growing distances and then narrowing down by bisection. A node
+ * belongs before key if it compares less, or equal unless strict is set. The
+ * list still has to be walked, but only O(log n) comparisons are made for a
+ * stretch of n nodes. Return the number of nodes moved.
+ */
+size_t q_gallop(struct list_head ***tail,
+                struct list_head **run,
+                const struct list_head *key,
+                bool strict,
+                bool descend)
+{
+    /* lo is the last node known to belong before key, at position lo_ofs.
+     * Positions count from 1 at the first node of the run.
+     */
+    struct list_head *lo = NULL, *probe = *run;
+    size_t lo_ofs = 0, hi_ofs = 0, pos = 1, target = 1;
+
+    /* Exponential search: probe positions 1, 2, 4, 8, ... */
+    for (;;) {
+        while (pos < target && probe->next) {
+            probe = probe->next;
+            pos++;
+        }
+        int cmp = q_strncmp(probe, key);
+        if (descend)
+            cmp = -cmp;
+        if (strict ? cmp >= 0 : cmp > 0) {
+            hi_ofs = pos;
+            break;
+        }
+        lo = probe;
+        lo_ofs = pos;
+        if (!probe->next)
+            break;
+        target <<= 1;
+    }
+
+    /* Bisect between lo and the first failing probe at hi_ofs */
+    while (hi_ofs && hi_ofs - lo_ofs > 1) {
+        size_t mid_ofs = lo_ofs + (hi_ofs - lo_ofs) / 2;
+        struct list_head *mid = lo ? lo : *run;
+        for (size_t i = lo ? lo_ofs : 1; i < mid_ofs; i++)
+            mid = mid->next;
+        int cmp = q_strncmp(mid, key);
+        if (descend)
+            cmp = -cmp;
+        if (strict ? cmp >= 0 : cmp > 0) {
+            hi_ofs = mid_ofs;
+        } else {
+            lo = mid;
+            lo_ofs = mid_ofs;
+        }
+    }
+
+    if (!lo)
+        return 0;
+    **tail = *run;
+    *tail = &lo->next;
+    *run = lo->next;
+    return lo_ofs;
+}
+
+/*
+ * Merge run y into the run x which precedes it in the input. When one run
+ * entirely precedes the other they are concatenated in constant time.
+ * Otherwise nodes are merged one at a time until one run wins MIN_GALLOP
+ * times in a row, after which whole stretches are moved by q_gallop() for as
+ * long as that pays off.
+ */
+void q_merge_adjacent(q_run_t *x, const q_run_t *y, bool descend)
+{
+    int cmp = q_strncmp(x->tail, y->head);
+    if ((descend ? -cmp : cmp) <= 0) {
+        x->tail->next = y->head;
+        x->tail = y->tail;
+        x->len += y->len;
+        return;
+    }
+    cmp = q_strncmp(y->tail, x->head);
+    if ((descend ? -cmp : cmp) < 0) {
+        y->tail->next = x->head;
+        x->head = y->head;
+        x->len += y->len;
+        return;
+    }
+
+    struct list_head *head = NULL, **tail = &head;
+    struct list_head *a = x->head, *b = y->head;
+    int min_gallop = MIN_GALLOP;
+
+    while (a && b) {
+        int win_a = 0, win_b = 0;
+
+        while (a && b && win_a < min_gallop && win_b < min_gallop) {
+            cmp = q_strncmp(a, b);
+            if ((descend ? -cmp : cmp) <= 0) {
+                *tail = a;
+                tail = &a->next;
+                a = a->next;
+                win_a++;
+                win_b = 0;
+            } else {
+                *tail = b;
+                tail = &b->next;
+                b = b->next;
+                win_b++;
+                win_a = 0;
+            }
+        }
+
+        while (a && b) {
+            size_t moved_a = q_gallop(&tail, &a, b, false, descend);
+            if (!a)
+                break;
+            size_t moved_b = q_gallop(&tail, &b, a, true, descend);
+            if (moved_a < MIN_GALLOP && moved_b < MIN_GALLOP) {
+                min_gallop++;
+                break;
+            }
+            if (min_gallop > 1)
+                min_gallop--;
+        }
+    }
+
+    *tail = a ? a : b;
+    x->head = head;
+    if (!a)
+        x->tail = y->tail;
+    x->len += y->len;
+}
+
+/*
+ * Adaptive merge sort in the style of Timsort. The input is split into its
+ * natural runs, which are pushed onto a stack and merged following Timsort's
+ * invariants on their lengths. Input that already is one ascending or one
+ * strictly descending run is sorted with n - 1 comparisons.
+ */
+struct list_head *q_tim_sort(struct list_head *head, bool descend)
+{
+    q_run_t runs[MAX_RUNS];
+    struct list_head *list = head->next;
+    int n_runs = 0;
+
+    head->prev->next = NULL;
+
+    /* Input that is a single ascending run is left as it is */
+    list = q_find_run(list, &runs[n_runs++], descend);
+    if (!list && runs[0].head == head->next) {
+        runs[0].tail->next = head;
+        return head;
+    }
+
+    while (list) {
+        list = q_find_run(list, &runs[n_runs++], descend);
+
+        /* Restore the invariants on the top of the run stack */
+        while (n_runs > 1) {
+            int n = n_runs - 2;
+            if ((n > 0 && runs[n - 1].len <= runs[n].len + runs[n + 1].len) ||
+                (n > 1 && runs[n - 2].len <= runs[n - 1].len + runs[n].len)) {
+                if (runs[n - 1].len < runs[n + 1].len)
+                    n--;
+            } else if (runs[n].len > runs[n + 1].len) {
+                break;
+            }
+            q_merge_adjacent(&runs[n], &runs[n + 1], descend);
+            for (int i = n + 1; i < n_runs - 1; i++)
+                runs[i] = runs[i + 1];
+            n_runs--;
+        }
+    }
+
+    while (n_runs > 1) {
+        int n = n_runs - 2;
+        if (n > 0 && runs[n - 1].len < runs[n + 1].len)
+            n--;
+        q_merge_adjacent(&runs[n], &runs[n + 1], descend);
+        for (int i = n + 1; i < n_runs - 1; i++)
+            runs[i] = runs[i + 1];
+        n_runs--;
+    }
+
+    /* Rebuild the prev pointers and close the circle */
+    struct list_head *prev = head;
+    for (struct list_head *cur = runs[0].head; cur; cur = cur->next) {
+        cur->prev = prev;
+        prev->next = cur;
+        prev = cur;
+    }
+    prev->next = head;
+    head->prev = prev;
+    return head;
+}
+
+int q_entry_cmp(const q_sort_entry_t *a, const q_sort_entry_t *b, bool descend)
+{
+    int cmp = a->prefix < b->prefix   ? -1
+              : a->prefix > b->prefix ? 1
+                                      : q_strncmp(a->node, b->node);
+    return descend ? -cmp : cmp;
+}
+
+/*
+ * Sort through a contiguous array of node pointers and the cached string
+ * prefixes, taken from the harness scratch buffer. Most comparisons are
+ * settled by the cached prefixes without touching the nodes, and the list is
+ * relinked once at the end. Fall back to q_list_sort() if no scratch buffer
+ * is available.
+ */
+struct list_head *q_array_sort(struct list_head *head, bool descend)
+{
+    size_t n = q_size(head);
+    q_sort_entry_t *src = test_scratch(2 * n * sizeof(q_sort_entry_t));
+    if (!src)
+        return q_list_sort(head, descend);
+
+    size_t i = 0;
+    struct list_head *node;
+    list_for_each (node, head) {
+        src[i].prefix = list_entry(node, element_t, list)->prefix;
+        src[i++].node = node;
+    }
+    src = q_sort_entries(src, src + n, n, descend);
+
+    struct list_head *prev = head;
+    for (i = 0; i < n; i++) {
+        prev->next = src[i].node;
+        src[i].node->prev = prev;
+        prev = src[i].node;
+    }
+    prev->next = head;
+    head->prev = prev;
+    return head;
+}
+
+/*
+ * Stable merge sort of the n entries of src, using dst as much space again.
+ * Return whichever of the two holds the result.
+ */
+q_sort_entry_t *q_sort_entries(q_sort_entry_t *src,
+                               q_sort_entry_t *dst,
+                               size_t n,
+                               bool descend)
+{
+    /* Stable insertion sort of short blocks */
+    for (size_t lo = 0; lo < n; lo += ARRAY_RUN) {
+        size_t hi = lo + ARRAY_RUN < n ? lo + ARRAY_RUN : n;
+        for (size_t j = lo + 1; j < hi; j++) {
+            q_sort_entry_t tmp = src[j];
+            size_t k = j;
+            for (; k > lo && q_entry_cmp(&src[k - 1], &tmp, descend) > 0; k--)
+                src[k] = src[k - 1];
+            src[k] = tmp;
+        }
+    }
+
+    /* Merge blocks of doubling width, ping-ponging between the two halves */
+    for (size_t width = ARRAY_RUN; width < n; width *= 2) {
+        for (size_t lo = 0; lo < n; lo += 2 * width) {
+            size_t mid = lo + width < n ? lo + width : n;
+            size_t hi = lo + 2 * width < n ? lo + 2 * width : n;
+            size_t a = lo, b = mid, k = lo;
+            while (a < mid && b < hi)
+                dst[k++] = q_entry_cmp(&src[b], &src[a], descend) < 0
+                               ? src[b++]
+                               : src[a++];
+            while (a < mid)
+                dst[k++] = src[a++];
+            while (b < hi)
+                dst[k++] = src[b++];
+        }
+        q_sort_entry_t *tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+    return src;
+}
+
+/*
+ * Sort an array of n element pointers in place like q_array_sort(). Return
+ * false, leaving the array alone, if no scratch buffer is available.
+ */
+bool q_sort_elements(element_t **a, size_t n, bool descend)
+{
+    q_sort_entry_t *src = test_scratch(2 * n * sizeof(q_sort_entry_t));
+    if (!src)
+        return false;
+
+    for (size_t i = 0; i < n; i++) {
+        src[i].prefix = a[i]->prefix;
+        src[i].node = &a[i]->list;
+    }
+    src = q_sort_entries(src, src + n, n, descend);
+    for (size_t i = 0; i < n; i++)
+        a[i] = list_entry(src[i].node, element_t, list);
+    return true;
+}
+
+/*
+ * MSD radix sort of n entries whose strings agree on their first depth bytes.
+ * Each pass distributes the entries by the byte at depth with a stable counting
+ * sort through aux. Strings ending at depth are equal and stay in input order.
+ * The other buckets are sorted on the next byte: the largest one by looping,
+ * the rest by recursion, so the recursion depth stays logarithmic in n. For
+ * descending order the bucket order is inverted, which still leaves equal
+ * strings in input order.
+ */
+void q_radix_sort_range(q_radix_entry_t *a,
+                        q_radix_entry_t *aux,
+                        size_t n,
+                        size_t depth,
+                        bool descend)
+{
+    const unsigned flip = descend ? 255 : 0;
+
+    while (n > RADIX_CUTOFF) {
+        size_t count[256] = {0}, start[256], pos[256];
+
+        for (size_t i = 0; i < n; i++)
+            count[a[i].s[depth] ^ flip]++;
+        for (size_t b = 0, sum = 0; b < 256; b++) {
+            start[b] = pos[b] = sum;
+            sum += count[b];
+        }
+        for (size_t i = 0; i < n; i++)
+            aux[pos[a[i].s[depth] ^ flip]++] = a[i];
+        memcpy(a, aux, n * sizeof(q_radix_entry_t));
+
+        /* Bucket flip holds the strings which end here */
+        int largest = -1;
+        for (int b = 0; b < 256; b++) {
+            if (b == (int) flip || count[b] < 2)
+                continue;
+            if (largest < 0 || count[b] > count[largest])
+                largest = b;
+        }
+        for (int b = 0; b < 256; b++) {
+            if (b == (int) flip || b == largest || count[b] < 2)
+                continue;
+            q_radix_sort_range(a + start[b], aux + start[b], count[b],
+                               depth + 1, descend);
+        }
+        if (largest < 0)
+            return;
+        a += start[largest];
+        aux += start[largest];
+        n = count[largest];
+        depth++;
+    }
+
+    /* Stable insertion sort on the remaining bytes */
+    for (size_t j = 1; j < n; j++) {
+        q_radix_entry_t tmp = a[j];
+        size_t k = j;
+        for (; k > 0; k--) {
+            int cmp = strcmp((const char *) a[k - 1].s + depth,
+                             (const char *) tmp.s + depth);
+            if ((descend ? -cmp : cmp) <= 0)
+                break;
+            a[k] = a[k - 1];
+        }
+        a[k] = tmp;
+    }
+}
+
+/*
+ * Sort by MSD radix on the bytes of the strings, which takes time close to
+ * linear in the total length of the distinguishing prefixes. The entries and
+ * the distribution buffer come from the harness scratch buffer; fall back to
+ * q_list_sort() if it is not available.
+ */
+struct list_head *q_radix_sort(struct list_head *head, bool descend)
+{
+    size_t n = q_size(head);
+    q_radix_entry_t *a = test_scratch(2 * n * sizeof(q_radix_entry_t));
+    if (!a)
+        return q_list_sort(head, descend);
+
+    size_t i = 0;
+    struct list_head *node;
+    list_for_each (node, head) {
+        a[i].s =
+            (const unsigned char *) q_value(list_entry(node, element_t, list));
+        a[i++].node = node;
+    }
+
+    q_radix_sort_range(a, a + n, n, 0, descend);
+
+    struct list_head *prev = head;
+    for (i = 0; i < n; i++) {
+        prev->next = a[i].node;
+        a[i].node->prev = prev;
+        prev = a[i].node;
+    }
+    prev->next = head;
+    head->prev = prev;
+    return head;
+}
+
+/*
+ * Run one task of the parallel sort. Segments are sorted with whichever of
+ * the allocation-free list sorts is selected, since the array-based ones share
+ * the single harness scratch buffer.
+ */
+void *q_sort_worker(void *arg)
+{
+    const q_sort_task_t *task = arg;
+
+    if (!task->b) {
+        if (sort_algo == SORT_MERGE)
+            q_merge_sort(task->a, task->descend);
+        else if (sort_algo == SORT_TIM)
+            q_tim_sort(task->a, task->descend);
+        else
+            q_list_sort(task->a, task->descend);
+        return NULL;
+    }
+
+    /* Both segments are non-empty; a precedes b in the original order */
+    struct list_head *a = task->a->next, *b = task->b->next;
+    task->a->prev->next = NULL;
+    task->b->prev->next = NULL;
+    q_merge_final(task->a, a, b, task->descend);
+    INIT_LIST_HEAD(task->b);
+    return NULL;
+}
+
+/*
+ * Run the tasks concurrently, the first one on the calling thread, and return
+ * once all of them are done. Signals are blocked in the workers so that they
+ * are always delivered to the calling thread. A task whose thread cannot be
+ * created is run by the caller instead.
+ */
+void q_run_tasks(q_sort_task_t *tasks, int n_tasks)
+{
+    pthread_t threads[PAR_MAX_THREADS];
+    bool started[PAR_MAX_THREADS] = {false};
+    sigset_t all, old;
+
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    for (int i = 1; i < n_tasks; i++)
+        started[i] =
+            !pthread_create(&threads[i], NULL, q_sort_worker, &tasks[i]);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    q_sort_worker(&tasks[0]);
+    for (int i = 1; i < n_tasks; i++) {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+        else
+            q_sort_worker(&tasks[i]);
+    }
+}
+
+/*
+ * Sort on up to sort_threads threads: cut the list into contiguous segments,
+ * sort them concurrently, then merge neighbouring segments pairwise, again
+ * concurrently, until one is left. Merges take ties from the earlier segment,
+ * so the result is the same as that of a stable sequential sort. Return false
+ * without touching the list if it is too short to be worth splitting.
+ *
+ * The workers use the segments and tasks on this stack frame, and the list is
+ * scattered over the segments until the end. The time limit alarm of the
+ * harness, which leaves through siglongjmp(), is therefore held back until
+ * the list is whole again and every worker has been joined.
+ */
+bool q_parallel_sort(struct list_head *head, bool descend)
+{
+    int n = q_size(head);
+    int parts = sort_threads < PAR_MAX_THREADS ? sort_threads : PAR_MAX_THREADS;
+    if (parts > n / PAR_MIN_SEGMENT)
+        parts = n / PAR_MIN_SEGMENT;
+    if (parts < 2)
+        return false;
+
+    struct list_head segs[PAR_MAX_THREADS];
+    q_sort_task_t tasks[PAR_MAX_THREADS];
+    sigset_t alarm, old;
+
+    sigemptyset(&alarm);
+    sigaddset(&alarm, SIGALRM);
+    pthread_sigmask(SIG_BLOCK, &alarm, &old);
+
+    for (int i = 0; i < parts; i++) {
+        int len = n / parts + (i < n % parts);
+        struct list_head *last = head;
+        while (len--)
+            last = last->next;
+        INIT_LIST_HEAD(&segs[i]);
+        list_cut_position(&segs[i], head, last);
+        tasks[i] =
+            (q_sort_task_t){.a = &segs[i], .b = NULL, .descend = descend};
+    }
+    q_run_tasks(tasks, parts);
+
+    for (int step = 1; step < parts; step *= 2) {
+        int n_tasks = 0;
+        for (int i = 0; i + step < parts; i += 2 * step) {
+            tasks[n_tasks++] = (q_sort_task_t){
+                .a = &segs[i], .b = &segs[i + step], .descend = descend};
+        }
+        q_run_tasks(tasks, n_tasks);
+    }
+
+    list_splice(&segs[0], head);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    return true;
+}
+
 /* Sort elements of queue in ascending/descending order */
 void q_sort(struct list_head *head, bool descend)
 {
+    element_t **a = q_store_array(head);
+    if (a && q_sort_elements(a, q_size(head), descend))
+        return;
+
+    if (q_store_link(head)) {
+        q_sort(head, descend);
+        q_store_unlink(head);
+        return;
+    }
+
     if (!head || list_empty(head) || list_is_singular(head))
         return;
 
+    q_index_invalidate(head);
+    if (sort_threads > 1 && q_parallel_sort(head, descend))
+        return;
+
     /*
      * If you want to use bubble sort, then call q_bubble_sort(head, descend);
-     * If you want to use merge sort, then call q_merge_sort(head, descend);
      *
-     * Be careful, the descending order sorting is not stable sorting.
+     * The remaining strategies are stable in both orders and can be chosen at
+     * run time through sort_algo.
      */
 
-    q_merge_sort(head, descend);
+    switch (sort_algo) {
+    case SORT_MERGE:
+        q_merge_sort(head, descend);
+        break;
+    case SORT_TIM:
+        q_tim_sort(head, descend);
+        break;
+    case SORT_ARRAY:
+        q_array_sort(head, descend);
+        break;
+    case SORT_RADIX:
+        q_radix_sort(head, descend);
+        break;
+    default:
+        q_list_sort(head, descend);
+        break;
+    }
 }
 
 
@@ -360,23 +2015,27 @@ void q_sort(struct list_head *head, bool descend)
 int q_ascend(struct list_head *head)
 {
     // https://leetcode.com/problems/remove-nodes-from-linked-list/
+    if (q_store_link(head)) {
+        int size = q_ascend(head);
+        q_store_unlink(head);
+        return size;
+    }
+
     if (!head || list_empty(head))
         return 0;
     else if (list_is_singular(head))
         return 1;
 
     struct list_head *small = head->next, *big = head->next->next;
-    int cnt = 0;
     while (small != head && big != head) {
         while (big != head && q_strncmp(small, big) > 0) {
-            q_delete_element(big);
+            q_delete_element(head, big);
             big = small->next;
         }
         small = big;
         big = big->next;
-        cnt += 1;
     }
-    return cnt;
+    return q_size(head);
 }
 
 /* Delete every node which has a node with a strictly greater value anywhere to
@@ -384,23 +2043,27 @@ int q_ascend(struct list_head *head)
 int q_descend(struct list_head *head)
 {
     // https://leetcode.com/problems/remove-nodes-from-linked-list/
+    if (q_store_link(head)) {
+        int size = q_descend(head);
+        q_store_unlink(head);
+        return size;
+    }
+
     if (!head || list_empty(head))
         return 0;
     else if (list_is_singular(head))
         return 1;
 
     struct list_head *big = head->prev->prev, *small = head->prev;
-    int cnt = 0;
     while (big != head && small != head) {
         while (big != head && q_strncmp(big, small) < 0) {
-            q_delete_element(big);
+            q_delete_element(head, big);
             big = small->prev;
         }
         small = big;
         big = big->prev;
-        cnt += 1;
     }
-    return cnt;
+    return q_size(head);
 }
 
 struct list_head *q_merge_two_lists(struct list_head *head_a,
@@ -410,9 +2073,13 @@ struct list_head *q_merge_two_lists(struct list_head *head_a,
     struct list_head *ptr = head_a;
     struct list_head *a = head_a->next, *b = head_b->next;
 
+    /* Only take from a when it is strictly first, q_merge_sort() relies on
+     * this to be stable in both orders.
+     */
     for (struct list_head **node = NULL; a != head_a && b != head_b;
          *node = (*node)->next) {
-        node = ((q_strncmp(a, b) < 0) ^ descend) ? &a : &b;
+        int cmp = q_strncmp(a, b);
+        node = ((descend ? -cmp : cmp) < 0) ? &a : &b;
         ptr->next = *node;
         (*node)->prev = ptr;
         ptr = (*node);
@@ -431,6 +2098,29 @@ struct list_head *q_merge_two_lists(struct list_head *head_a,
     return head_a;
 }
 
+/* Hand the arena of src, whose elements were just moved to dst, over to dst */
+void q_merge_arenas(queue_head_t *dst, queue_head_t *src)
+{
+    if (!src->arena) {
+        dst->foreign = dst->foreign || src->foreign || dst->arena != NULL;
+        return;
+    }
+
+    if (dst->arena) {
+        /* src is empty now, so it need not keep a handle on the memory */
+        test_arena_merge(dst->arena, src->arena);
+        test_arena_release(src->arena);
+        src->arena = NULL;
+        dst->foreign = dst->foreign || src->foreign;
+    } else {
+        /* dst has plain elements, so it can no longer drop them in bulk */
+        dst->arena = src->arena;
+        dst->foreign = true;
+        src->arena = NULL;
+    }
+    src->foreign = false;
+}
+
 /* Merge all the queues into one sorted queue, which is in ascending/descending
  * order */
 int q_merge(struct list_head *head, bool descend)
@@ -442,6 +2132,20 @@ int q_merge(struct list_head *head, bool descend)
     else if (size == 1)
         return q_size(list_entry(head->next, queue_contex_t, chain)->q);
 
+    /* Queues kept in stores take part through their heads. The first one
+     * must have room for every element beforehand.
+     */
+    queue_contex_t *ctx;
+    int total = 0;
+    list_for_each_entry (ctx, head, chain)
+        total += q_size(ctx->q);
+    queue_head_t *first =
+        q_head(list_first_entry(head, queue_contex_t, chain)->q);
+    if (first->ops && !first->ops->reserve(first->store, total))
+        return first->size;
+    list_for_each_entry (ctx, head, chain)
+        q_store_link(ctx->q);
+
     struct list_head *ptr = head->next, *ptr_end = head->prev;
     for (; size != 1; size = (size + 1) / 2) {
         for (int cnt = size / 2; cnt != 0; cnt--) {
@@ -449,6 +2153,11 @@ int q_merge(struct list_head *head, bool descend)
             struct list_head *right =
                 list_entry(ptr_end, queue_contex_t, chain)->q;
             q_merge_two_lists(left, right, descend);
+            q_head(left)->size += q_head(right)->size;
+            q_head(right)->size = 0;
+            q_merge_arenas(q_head(left), q_head(right));
+            q_index_invalidate(left);
+            q_index_invalidate(right);
             right = NULL;
             ptr = ptr->next;
             ptr_end = ptr_end->prev;
@@ -456,27 +2165,75 @@ int q_merge(struct list_head *head, bool descend)
         ptr = head->next;
     }
 
+    list_for_each_entry (ctx, head, chain) {
+        if (q_head(ctx->q)->ops)
+            q_store_unlink(ctx->q);
+    }
     return q_size(list_entry(ptr, queue_contex_t, chain)->q);
 }
 
+/*
+ * Shuffle with the Fisher-Yates algorithm on a snapshot of the node pointers
+ * taken into the harness scratch buffer, then relink the list in one pass.
+ * Random numbers come from the process-wide generator, see prng_seed().
+ * Without a scratch buffer, repeatedly move a randomly chosen node among the
+ * not yet placed ones to the tail, which takes quadratic time.
+ */
 void q_shuffle(struct list_head *head)
 {
-    if (!head || list_empty(head) || list_is_singular(head)) {
+    element_t **a = q_store_array(head);
+    if (a) {
+        for (int i = q_size(head) - 1; i > 0; i--) {
+            int j = prng_next() % (i + 1);
+            element_t *tmp = a[i];
+            a[i] = a[j];
+            a[j] = tmp;
+        }
         return;
     }
 
-    srand(time(NULL));
+    if (q_store_link(head)) {
+        q_shuffle(head);
+        q_store_unlink(head);
+        return;
+    }
 
-    struct list_head *ptr_end = head->prev;
+    if (!head || list_empty(head) || list_is_singular(head)) {
+        return;
+    }
 
-    for (int turn = q_size(head) - 1; turn; turn -= 1) {
-        struct list_head *ptr = head->next;
-        int r = rand();
-        for (r = (int) ((float) r / ((unsigned) RAND_MAX + 1) * turn); r;
-             r -= 1) {
-            ptr = ptr->next;
+    q_index_invalidate(head);
+    size_t n = q_size(head);
+    struct list_head **nodes = test_scratch(n * sizeof(struct list_head *));
+
+    if (!nodes) {
+        for (size_t left = n; left > 1; left--) {
+            struct list_head *ptr = head->next;
+            for (uint64_t r = prng_next() % left; r; r--)
+                ptr = ptr->next;
+            list_move_tail(ptr, head);
         }
-        q_swap_two_node(ptr, ptr_end);
-        ptr_end = ptr->prev;
+        return;
+    }
+
+    size_t i = 0;
+    struct list_head *node;
+    list_for_each (node, head)
+        nodes[i++] = node;
+
+    for (i = n - 1; i > 0; i--) {
+        size_t j = prng_next() % (i + 1);
+        struct list_head *tmp = nodes[i];
+        nodes[i] = nodes[j];
+        nodes[j] = tmp;
+    }
+
+    struct list_head *prev = head;
+    for (i = 0; i < n; i++) {
+        prev->next = nodes[i];
+        nodes[i]->prev = prev;
+        prev = nodes[i];
     }
-}
\ No newline at end of file
+    prev->next = head;
+    head->prev = prev;
+}
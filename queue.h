@@ -4,27 +4,102 @@
 /* This program implements a queue supporting both FIFO and LIFO
  * operations.
  *
- * It uses a circular doubly-linked list to represent the set of queue elements
+ * By default it uses a circular doubly-linked list to represent the set of
+ * queue elements. Queues created with another queue_backend keep pointers to
+ * their elements in an unrolled linked list or a ring buffer instead.
  */
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #include "harness.h"
+#include "intern.h"
 #include "list.h"
 
 /**
  * element_t - Linked list element
- * @value: pointer to array holding string
+ * @value: pointer to array holding string, or to the handle in @data
  * @list: node of a doubly-linked list
- *
- * @value needs to be explicitly allocated and freed
+ * @len: length of the string, excluding the terminator
+ * @interned: whether @data holds a handle rather than the string
+ * @prefix: first eight bytes of the string, big-endian and zero-padded
+ * @data: inline storage for the string or the handle
+ *
+ * Elements created by queue.c are a single allocation: the string is stored
+ * in @data right after the node, and @value points at it. @len and @prefix
+ * are filled in on insertion so that comparisons rarely touch the string.
+ *
+ * Elements inserted with intern_mode set are @interned: @data only holds a
+ * handle, a pointer to a copy of the string shared with every such element
+ * holding an equal string, see intern_get(). @value still points at @data,
+ * so each element keeps a pointer of its own. Read the string through
+ * q_value().
  */
 typedef struct {
     char *value;
     struct list_head list;
+    uint32_t len;
+    bool interned;
+    uint64_t prefix;
+    char data[];
 } element_t;
 
+/**
+ * queue_head_t - Header of a queue which keeps track of its length
+ * @head: head of the circular doubly-linked list, handed out by q_new()
+ * @size: the number of elements linked into @head
+ * @arena: harness arena the elements are allocated from, or NULL
+ * @foreign: whether @head may also hold elements not allocated from @arena
+ * @index: order-statistic index over the elements, or NULL
+ * @ops: operations of @store, or NULL if the elements are linked into @head
+ * @store: array-like structure holding pointers to the elements, or NULL
+ *
+ * Every operation in queue.c that links or unlinks an element updates @size,
+ * so that q_size() does not have to walk the list. Callers keep using the
+ * embedded @head as the queue handle.
+ *
+ * When the harness hands out arenas, every element of the queue comes from
+ * @arena and, unless @foreign is set, q_free() releases them all at once
+ * instead of freeing elements one by one. Elements removed from the
+ * queue stay valid until they are released or the queue is freed. If the
+ * arena is shared with another queue, see q_split(), elements are freed one
+ * by one as well.
+ *
+ * With index_mode set, positional operations build @index on first use.
+ * Insertions and removals at either end and positional deletions keep it up
+ * to date, while operations that rearrange the queue only mark it stale, to
+ * be rebuilt by the next positional operation.
+ *
+ * Queues created with a backend other than BACKEND_LIST leave @head empty
+ * and keep their elements in @store. Insertions, removals and positional
+ * operations go to the store directly. Reversing, sorting and shuffling
+ * work on the array of a store which keeps one. Other operations that
+ * rearrange the queue link the elements through @head for the duration of
+ * the call, run the list algorithm and write the new order back. Walk the
+ * elements of any queue with q_for_each_entry() rather than through @head.
+ */
+typedef struct {
+    struct list_head head;
+    int size;
+    test_arena_t *arena;
+    bool foreign;
+    struct q_index *index;
+    const struct q_store_ops *ops;
+    void *store;
+} queue_head_t;
+
+/**
+ * q_head() - Get the counted header of a queue
+ * @head: header of queue, as returned by q_new()
+ *
+ * Return: the queue_head_t embedding @head
+ */
+static inline queue_head_t *q_head(struct list_head *head)
+{
+    return list_entry(head, queue_head_t, head);
+}
+
 /**
  * queue_contex_t - The context managing a chain of queues
  * @q: pointer to the head of the queue
@@ -39,11 +114,73 @@ typedef struct {
     int id;
 } queue_contex_t;
 
+/**
+ * sort_algo_t - Strategies q_sort() can dispatch to
+ * @SORT_LIST: bottom-up merge sort in the style of the Linux list_sort()
+ * @SORT_MERGE: top-down recursive merge sort
+ * @SORT_TIM: adaptive merge sort of natural runs with galloping
+ * @SORT_ARRAY: merge sort of a contiguous array of nodes and key prefixes
+ * @SORT_RADIX: MSD radix sort on the bytes of the strings
+ */
+typedef enum {
+    SORT_LIST,
+    SORT_MERGE,
+    SORT_TIM,
+    SORT_ARRAY,
+    SORT_RADIX,
+} sort_algo_t;
+
+/* Strategy used by q_sort(), one of sort_algo_t */
+extern int sort_algo;
+
+/* Number of threads q_sort() may use. With more than one, long queues are
+ * cut into segments which are sorted and merged concurrently.
+ */
+extern int sort_threads;
+
+/* Nonzero to let q_at(), q_delete_at(), q_delete_mid() and q_split() reach
+ * positions in logarithmic time through an index kept with the queue.
+ */
+extern int index_mode;
+
+/* Nonzero to let new elements share one interned copy of equal strings */
+extern int intern_mode;
+
+/**
+ * q_backend_t - Structures a queue can keep its elements in
+ * @BACKEND_LIST: circular doubly-linked list through the nodes of elements
+ * @BACKEND_UNROLLED: list of chunks, each holding a few element pointers
+ * @BACKEND_RING: circular array of element pointers, doubled when full
+ */
+typedef enum {
+    BACKEND_LIST,
+    BACKEND_UNROLLED,
+    BACKEND_RING,
+} q_backend_t;
+
+/* Backend of the queues q_new() creates, one of q_backend_t */
+extern int queue_backend;
+
+/**
+ * q_iter_t - Position of a walk over the elements of a queue
+ * @head: header of the queue
+ * @node: where the walk is, in terms of the backend of the queue
+ * @pos: offset of the next element from @node
+ */
+typedef struct {
+    struct list_head *head;
+    void *node;
+    int pos;
+} q_iter_t;
+
 /* Operations on queue */
 
 /**
  * q_new() - Create an empty queue whose next and prev pointer point to itself
  *
+ * The returned list head is embedded in a queue_head_t. Only heads obtained
+ * from q_new() may be passed to the other queue operations.
+ *
  * Return: NULL for allocation failed
  */
 struct list_head *q_new();
@@ -78,6 +215,35 @@ bool q_insert_head(struct list_head *head, char *s);
  */
 bool q_insert_tail(struct list_head *head, char *s);
 
+/**
+ * q_insert_head_bulk() - Insert several elements at the head
+ * @head: header of queue
+ * @strs: strings to be inserted
+ * @n: number of strings in @strs
+ *
+ * Same as calling q_insert_head() for @strs[0] up to @strs[n - 1] in turn,
+ * so @strs[n - 1] ends up first. The new elements are chained privately
+ * and spliced into the queue at once. If an allocation fails, the elements
+ * built so far are still inserted.
+ *
+ * Return: the number of strings inserted, from the start of @strs
+ */
+int q_insert_head_bulk(struct list_head *head, char **strs, int n);
+
+/**
+ * q_insert_tail_bulk() - Insert several elements at the tail
+ * @head: header of queue
+ * @strs: strings to be inserted
+ * @n: number of strings in @strs
+ *
+ * Same as calling q_insert_tail() for @strs[0] up to @strs[n - 1] in turn.
+ * The new elements are chained privately and spliced into the queue at
+ * once. If an allocation fails, the elements built so far are still inserted.
+ *
+ * Return: the number of strings inserted, from the start of @strs
+ */
+int q_insert_tail_bulk(struct list_head *head, char **strs, int n);
+
 /**
  * q_remove_head() - Remove the element from head of queue
  * @head: header of queue
@@ -86,6 +252,7 @@ bool q_insert_tail(struct list_head *head, char *s);
  *
  * If sp is non-NULL and an element is removed, copy the removed string to *sp
  * (up to a maximum of bufsize-1 characters, plus a null terminator.)
+ * Bytes of sp past the terminator are left untouched.
  *
  * NOTE: "remove" is different from "delete"
  * The space used by the list element and the string should not be freed.
@@ -108,15 +275,78 @@ element_t *q_remove_head(struct list_head *head, char *sp, size_t bufsize);
  */
 element_t *q_remove_tail(struct list_head *head, char *sp, size_t bufsize);
 
+/**
+ * q_detach_head() - Unlink the element at the head of queue
+ * @head: header of queue
+ *
+ * Like q_remove_head() without copying the string: the caller reads @value
+ * of the returned element directly and releases the element when done.
+ *
+ * Return: the pointer to element, %NULL if queue is NULL or empty.
+ */
+element_t *q_detach_head(struct list_head *head);
+
+/**
+ * q_detach_tail() - Unlink the element at the tail of queue
+ * @head: header of queue
+ *
+ * Like q_remove_tail() without copying the string.
+ *
+ * Return: the pointer to element, %NULL if queue is NULL or empty.
+ */
+element_t *q_detach_tail(struct list_head *head);
+
+/**
+ * q_remove_head_n() - Remove up to n elements from the head of queue
+ * @head: header of queue
+ * @out: array receiving the removed elements, with room for @n entries
+ * @n: maximum number of elements to remove
+ *
+ * The elements are unlinked together and stored in @out in queue order, as
+ * repeated q_detach_head() calls would return them. Their strings are not
+ * copied, and releasing them is up to the caller.
+ *
+ * Return: the number of elements removed, 0 if queue is NULL or empty
+ */
+int q_remove_head_n(struct list_head *head, element_t **out, int n);
+
+/**
+ * q_remove_tail_n() - Remove up to n elements from the tail of queue
+ * @head: header of queue
+ * @out: array receiving the removed elements, with room for @n entries
+ * @n: maximum number of elements to remove
+ *
+ * Like q_remove_head_n(), with @out starting at the last element.
+ *
+ * Return: the number of elements removed, 0 if queue is NULL or empty
+ */
+int q_remove_tail_n(struct list_head *head, element_t **out, int n);
+
+/**
+ * q_value() - Get the string of an element
+ * @e: element holding the string
+ *
+ * Return: @e->value, or the shared copy its handle points at if @e is
+ * interned
+ */
+static inline char *q_value(const element_t *e)
+{
+    return e->interned ? *(char *const *) e->data : e->value;
+}
+
 /**
  * q_release_element() - Release the element
  * @e: element would be released
  *
+ * The string lives in the same block as the element, so a single free
+ * releases both, unless it is interned and only loses a reference.
+ *
  * This function is intended for internal use only.
  */
 static inline void q_release_element(element_t *e)
 {
-    test_free(e->value);
+    if (e->interned)
+        intern_put(q_value(e));
     test_free(e);
 }
 
@@ -124,10 +354,40 @@ static inline void q_release_element(element_t *e)
  * q_size() - Get the size of the queue
  * @head: header of queue
  *
+ * The length is maintained by every operation in queue.c, so this takes
+ * constant time.
+ *
  * Return: the number of elements in queue, zero if queue is NULL or empty
  */
 int q_size(struct list_head *head);
 
+/**
+ * q_iter_init() - Start a walk over the elements of a queue
+ * @it: walk to set up
+ * @head: header of queue
+ * @k: position of the first element to visit, 0 for the head
+ *
+ * The queue must not be changed until the walk is over.
+ */
+void q_iter_init(q_iter_t *it, struct list_head *head, int k);
+
+/**
+ * q_iter_next() - Advance a walk over the elements of a queue
+ * @it: walk set up by q_iter_init()
+ *
+ * Return: the next element, %NULL past the tail or if the queue is NULL
+ */
+element_t *q_iter_next(q_iter_t *it);
+
+/**
+ * q_for_each_entry() - Iterate over the elements of a queue from the head
+ * @entry: element_t pointer set to each element in turn
+ * @it: q_iter_t keeping track of the walk
+ * @head: header of queue
+ */
+#define q_for_each_entry(entry, it, head) \
+    for (q_iter_init(&(it), head, 0); ((entry) = q_iter_next(&(it)));)
+
 /**
  * q_delete_mid() - Delete the middle node in queue
  * @head: header of queue
@@ -164,6 +424,39 @@ bool q_delete_dup(struct list_head *head);
  */
 void q_swap(struct list_head *head);
 
+/**
+ * q_at() - Get the element at a position
+ * @head: header of queue
+ * @k: position of the element, counting from 0 at the head
+ *
+ * Return: the element, %NULL if queue is NULL or @k is out of range
+ */
+element_t *q_at(struct list_head *head, int k);
+
+/**
+ * q_delete_at() - Delete the element at a position
+ * @head: header of queue
+ * @k: position of the element, counting from 0 at the head
+ *
+ * Return: true if an element was deleted, false if queue is NULL or @k is
+ * out of range
+ */
+bool q_delete_at(struct list_head *head, int k);
+
+/**
+ * q_split() - Move the elements from a position on to another queue
+ * @head: header of queue
+ * @rest: header of an empty queue receiving the elements
+ * @k: position of the first element to move
+ *
+ * Afterwards @head keeps its first @k elements and @rest holds the others in
+ * the same order. If @head allocates from an arena, @rest shares it.
+ *
+ * Return: the number of elements moved, 0 if a queue is NULL, @rest is not
+ * empty or @k is out of range
+ */
+int q_split(struct list_head *head, struct list_head *rest, int k);
+
 /**
  * q_reverse() - Reverse elements in queue
  * @head: header of queue
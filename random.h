@@ -6,6 +6,13 @@
 
 extern int randombytes(uint8_t *buf, size_t len);
 
+/* Fast process-wide pseudo-random generator (xoshiro256**).
+ * It is not suitable for cryptographic use. Seed it once with prng_seed();
+ * reseeding with the same value reproduces the same sequence.
+ */
+void prng_seed(uint64_t seed);
+uint64_t prng_next(void);
+
 static inline uint8_t randombit(void)
 {
     uint8_t ret = 0;
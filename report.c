@@ -184,7 +184,7 @@ static void fail_fun(const char *format, const char *msg)
 }
 
 /* Maximum number of megabytes that application can use (0 = unlimited) */
-static int mblimit = 0;
+int mblimit = 0;
 
 /* Keeping track of memory allocation */
 static size_t allocate_cnt = 0;
@@ -298,6 +298,14 @@ void free_string(char *s)
     free_block((void *) s, strlen(s) + 1);
 }
 
+void report_mem_stat(mem_stat_t *stat)
+{
+    stat->live_blocks = allocate_cnt - free_cnt;
+    stat->live_bytes = current_bytes;
+    stat->peak_bytes = peak_bytes;
+    stat->overhead_bytes = 0;
+}
+
 /* Initialization of timers */
 void init_time(double *timep)
 {
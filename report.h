@@ -26,6 +26,20 @@ void report(int verblevel, char *fmt, ...);
 /* Like report, but without return character */
 void report_noreturn(int verblevel, char *fmt, ...);
 
+/* Maximum number of megabytes that application can use (0 = unlimited) */
+extern int mblimit;
+
+/* Memory usage of an allocator */
+typedef struct {
+    size_t live_blocks;    /* Blocks not freed yet */
+    size_t live_bytes;     /* Bytes requested for those blocks */
+    size_t peak_bytes;     /* Highest value live_bytes has reached */
+    size_t overhead_bytes; /* Bookkeeping added to the live blocks */
+} mem_stat_t;
+
+/* Fill stat with the usage of blocks from malloc_or_fail() and friends */
+void report_mem_stat(mem_stat_t *stat);
+
 /* Attempt to call malloc.  Fail when returns NULL */
 void *malloc_or_fail(size_t bytes, const char *fun_name);
 
@@ -0,0 +1,183 @@
+#include <stdlib.h>
+
+#include "backend.h"
+
+/* Ring buffer deque.
+ * The element pointers are kept in a circular array whose capacity is a power
+ * of two, from buf[head] on, wrapping around at the end. The array doubles
+ * when full, so insertions at either end take amortized constant time, and
+ * is never shrunk before the queue is freed. The elements are the only other
+ * memory the queue touches.
+ */
+#define RING_MIN 8
+
+typedef struct {
+    element_t **buf;
+    int capacity;
+    int head, count;
+} q_ring_t;
+
+/* Slot of position k */
+static inline element_t **ring_slot(const q_ring_t *r, int k)
+{
+    return &r->buf[(r->head + k) & (r->capacity - 1)];
+}
+
+static void *ring_create(void)
+{
+    q_ring_t *r = malloc(sizeof(q_ring_t));
+    if (!r)
+        return NULL;
+    r->buf = NULL;
+    r->capacity = 0;
+    r->head = 0;
+    r->count = 0;
+    return r;
+}
+
+static void ring_destroy(void *store)
+{
+    q_ring_t *r = store;
+    free(r->buf);
+    free(r);
+}
+
+/* Grow the array to capacity slots. The part of the queue which wrapped
+ * around to the start of the old array is moved right after its end.
+ */
+static bool ring_grow(q_ring_t *r, int capacity)
+{
+    element_t **buf = realloc(r->buf, capacity * sizeof(element_t *));
+    if (!buf)
+        return false;
+
+    int wrapped = r->head + r->count - r->capacity;
+    for (int i = 0; i < wrapped; i++)
+        buf[r->capacity + i] = buf[i];
+    r->buf = buf;
+    r->capacity = capacity;
+    return true;
+}
+
+static bool ring_reserve(void *store, int n)
+{
+    q_ring_t *r = store;
+    int capacity = r->capacity ? r->capacity : RING_MIN;
+    while (capacity < n)
+        capacity *= 2;
+    return capacity == r->capacity || ring_grow(r, capacity);
+}
+
+static bool ring_push(void *store, element_t *e, bool tail)
+{
+    q_ring_t *r = store;
+    if (r->count == r->capacity &&
+        !ring_grow(r, r->capacity ? 2 * r->capacity : RING_MIN))
+        return false;
+
+    if (!tail)
+        r->head = (r->head - 1) & (r->capacity - 1);
+    *ring_slot(r, tail ? r->count : 0) = e;
+    r->count++;
+    return true;
+}
+
+static element_t *ring_pop(void *store, bool tail)
+{
+    q_ring_t *r = store;
+    if (!r->count)
+        return NULL;
+
+    element_t *e = *ring_slot(r, tail ? r->count - 1 : 0);
+    if (!tail)
+        r->head = (r->head + 1) & (r->capacity - 1);
+    r->count--;
+    return e;
+}
+
+static element_t *ring_at(void *store, int k)
+{
+    return *ring_slot(store, k);
+}
+
+static element_t *ring_erase(void *store, int k)
+{
+    q_ring_t *r = store;
+    element_t *e = *ring_slot(r, k);
+
+    /* Close the gap from the shorter side */
+    if (k < r->count / 2) {
+        for (int i = k; i > 0; i--)
+            *ring_slot(r, i) = *ring_slot(r, i - 1);
+        r->head = (r->head + 1) & (r->capacity - 1);
+    } else {
+        for (int i = k + 1; i < r->count; i++)
+            *ring_slot(r, i - 1) = *ring_slot(r, i);
+    }
+    r->count--;
+    return e;
+}
+
+static void ring_seek(void *store, q_iter_t *it, int k)
+{
+    (void) store;
+    it->pos = k;
+}
+
+static element_t *ring_next(void *store, q_iter_t *it)
+{
+    q_ring_t *r = store;
+    if (it->pos >= r->count)
+        return NULL;
+    return *ring_slot(r, it->pos++);
+}
+
+static void ring_refill(void *store, struct list_head *head, int n)
+{
+    q_ring_t *r = store;
+    struct list_head *node = head->next;
+
+    if (n > r->capacity)
+        n = r->capacity;
+    for (int i = 0; i < n; i++, node = node->next)
+        r->buf[i] = list_entry(node, element_t, list);
+    r->head = 0;
+    r->count = n;
+}
+
+/* Reverse buf[lo] to buf[hi - 1] */
+static void ring_reverse(element_t **buf, int lo, int hi)
+{
+    for (hi--; lo < hi; lo++, hi--) {
+        element_t *tmp = buf[lo];
+        buf[lo] = buf[hi];
+        buf[hi] = tmp;
+    }
+}
+
+/* Rotate the array in place so that the queue starts at buf[0] */
+static element_t **ring_view(void *store)
+{
+    q_ring_t *r = store;
+    if (r->head) {
+        ring_reverse(r->buf, 0, r->head);
+        ring_reverse(r->buf, r->head, r->capacity);
+        ring_reverse(r->buf, 0, r->capacity);
+        r->head = 0;
+    }
+    return r->buf;
+}
+
+const q_store_ops_t ring_ops = {
+    .create = ring_create,
+    .destroy = ring_destroy,
+    .reserve = ring_reserve,
+    .push = ring_push,
+    .pop = ring_pop,
+    .at = ring_at,
+    .erase = ring_erase,
+    .seek = ring_seek,
+    .next = ring_next,
+    .refill = ring_refill,
+    .view = ring_view,
+};
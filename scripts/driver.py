@@ -35,7 +35,14 @@ class Tracer:
         14: "trace-14-perf",
         15: "trace-15-perf",
         16: "trace-16-perf",
-        17: "trace-17-complexity"
+        17: "trace-17-complexity",
+        18: "trace-18-sortalgo",
+        19: "trace-19-unrolled",
+        20: "trace-20-ring",
+        21: "trace-21-index",
+        22: "trace-22-remove-n",
+        23: "trace-23-arena",
+        24: "trace-24-mpmc"
     }
 
     traceProbs = {
@@ -55,10 +62,21 @@ class Tracer:
         14: "Trace-14",
         15: "Trace-15",
         16: "Trace-16",
-        17: "Trace-17"
+        17: "Trace-17",
+        18: "Trace-18",
+        19: "Trace-19",
+        20: "Trace-20",
+        21: "Trace-21",
+        22: "Trace-22",
+        23: "Trace-23",
+        24: "Trace-24"
     }
 
-    maxScores = [0, 5, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 5]
+    maxScores = [0, 5, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 5, 6, 6, 6, 6, 6, 6, 6]
+
+    # Traces from this one on cover optional features; their points are
+    # totalled apart so that the graded total stays at 100
+    firstExtra = 18
 
     RED = '\033[91m'
     GREEN = '\033[92m'
@@ -109,6 +127,8 @@ class Tracer:
             tidList = [tid]
         score = 0
         maxscore = 0
+        extra = 0
+        maxextra = 0
         if self.useValgrind:
             self.command = ['valgrind', self.qtest]
         else:
@@ -124,13 +144,20 @@ class Tracer:
                 self.printInColor("---\t%s\t%d/%d" % (tname, tval, maxval), self.RED)
             else:
                 self.printInColor("---\t%s\t%d/%d" % (tname, tval, maxval), self.GREEN)
-            score += tval
-            maxscore += maxval
+            if t < self.firstExtra:
+                score += tval
+                maxscore += maxval
+            else:
+                extra += tval
+                maxextra += maxval
             scoreDict[t] = tval
         if score < maxscore:
             self.printInColor("---\tTOTAL\t\t%d/%d" % (score, maxscore), self.RED)
-        else:
+        elif maxscore or not maxextra:
             self.printInColor("---\tTOTAL\t\t%d/%d" % (score, maxscore), self.GREEN)
+        if maxextra:
+            color = self.RED if extra < maxextra else self.GREEN
+            self.printInColor("---\tEXTRA\t\t%d/%d" % (extra, maxextra), color)
         if self.autograde:
             # Generate JSON string
             jstring = '{"scores": {'
@@ -142,7 +169,7 @@ class Tracer:
                 jstring += '"%s" : %d' % (self.traceProbs[k], scoreDict[k])
             jstring += '}}'
             print(jstring)
-        if score < maxscore:
+        if score < maxscore or extra < maxextra:
             sys.exit(1)
 
 def usage(name):
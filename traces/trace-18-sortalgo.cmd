@@ -0,0 +1,244 @@
+# Test of sort with every sortalgo, walking the result backwards
+option fail 0
+option malloc 0
+option sortalgo 0
+new
+it 1
+it 3
+it 2
+it 4
+sort
+reverse
+rt 1
+rt 2
+rh 4
+rh 3
+ih RAND 500
+sort
+reverse
+sort
+reverse
+rt
+rh
+dm
+swap
+sort
+rt
+free
+option sortalgo 1
+new
+it 1
+it 3
+it 2
+it 4
+sort
+reverse
+rt 1
+rt 2
+rh 4
+rh 3
+ih RAND 500
+sort
+reverse
+sort
+reverse
+rt
+rh
+dm
+swap
+sort
+rt
+free
+option sortalgo 2
+new
+it 1
+it 3
+it 2
+it 4
+sort
+reverse
+rt 1
+rt 2
+rh 4
+rh 3
+ih RAND 500
+sort
+reverse
+sort
+reverse
+rt
+rh
+dm
+swap
+sort
+rt
+free
+option sortalgo 3
+new
+it 1
+it 3
+it 2
+it 4
+sort
+reverse
+rt 1
+rt 2
+rh 4
+rh 3
+ih RAND 500
+sort
+reverse
+sort
+reverse
+rt
+rh
+dm
+swap
+sort
+rt
+free
+option sortalgo 4
+new
+it 1
+it 3
+it 2
+it 4
+sort
+reverse
+rt 1
+rt 2
+rh 4
+rh 3
+ih RAND 500
+sort
+reverse
+sort
+reverse
+rt
+rh
+dm
+swap
+sort
+rt
+free
+option descend 1
+option sortalgo 0
+new
+it 1
+it 3
+it 2
+it 4
+sort
+reverse
+rt 4
+rt 3
+rh 1
+rh 2
+ih RAND 500
+sort
+reverse
+sort
+reverse
+rt
+rh
+dm
+swap
+sort
+rt
+free
+option sortalgo 1
+new
+it 1
+it 3
+it 2
+it 4
+sort
+reverse
+rt 4
+rt 3
+rh 1
+rh 2
+ih RAND 500
+sort
+reverse
+sort
+reverse
+rt
+rh
+dm
+swap
+sort
+rt
+free
+option sortalgo 2
+new
+it 1
+it 3
+it 2
+it 4
+sort
+reverse
+rt 4
+rt 3
+rh 1
+rh 2
+ih RAND 500
+sort
+reverse
+sort
+reverse
+rt
+rh
+dm
+swap
+sort
+rt
+free
+option sortalgo 3
+new
+it 1
+it 3
+it 2
+it 4
+sort
+reverse
+rt 4
+rt 3
+rh 1
+rh 2
+ih RAND 500
+sort
+reverse
+sort
+reverse
+rt
+rh
+dm
+swap
+sort
+rt
+free
+option sortalgo 4
+new
+it 1
+it 3
+it 2
+it 4
+sort
+reverse
+rt 4
+rt 3
+rh 1
+rh 2
+ih RAND 500
+sort
+reverse
+sort
+reverse
+rt
+rh
+dm
+swap
+sort
+rt
+free
@@ -0,0 +1,257 @@
+# Test of insert, remove, delete_mid, swap, reverseK, sort and merge with
+# the unrolled list backend
+option fail 0
+option malloc 0
+option backend 1
+new
+it w00
+ih w17
+it w34
+ih w11
+it w28
+ih w05
+it w22
+ih w39
+it w16
+ih w33
+it w10
+ih w27
+it w04
+ih w21
+it w38
+ih w15
+it w32
+ih w09
+it w26
+ih w03
+it w20
+ih w37
+it w14
+ih w31
+it w08
+ih w25
+it w02
+ih w19
+it w36
+ih w13
+it w30
+ih w07
+it w24
+ih w01
+it w18
+ih w35
+it w12
+ih w29
+it w06
+ih w23
+rh w23
+rt w06
+rh w29
+rt w12
+dm
+size
+swap
+reverseK 3
+reverse
+dm
+reverseK 5
+rh w24
+rt w13
+rh w02
+rt w35
+rh w36
+rt w01
+rh w30
+rt w19
+rh w18
+rt w37
+rh w38
+rt w31
+sort
+swap
+reverseK 4
+rh w05
+rh w07
+rh w03
+rh w04
+rh w10
+rh w11
+rh w08
+rh w09
+rh w16
+rh w17
+rh w14
+rh w15
+rh w22
+rh w25
+rh w20
+rh w21
+rh w28
+rh w32
+rh w26
+rh w27
+rh w34
+rh w33
+free
+new
+ih x 20
+it y 20
+ih b
+it z
+ih a 3
+dm
+swap
+reverseK 7
+sort
+rt z
+rt y
+rt y
+rt y
+rt y
+reverse
+rh y
+rh y
+rh y
+rh y
+rh y
+rh y
+rh y
+rh y
+rh y
+rh y
+rh y
+rh y
+rh y
+rh y
+rh y
+rh y
+rh x
+rh x
+rh x
+rh x
+rh x
+rh x
+rh x
+rh x
+rh x
+rh x
+rh x
+rh x
+rh x
+rh x
+rh x
+rh x
+rh x
+rh x
+rh x
+rh b
+rh a
+rh a
+rh a
+free
+new
+it w00
+it w17
+it w34
+it w11
+it w28
+it w05
+it w22
+it w39
+it w16
+it w33
+it w10
+it w27
+it w04
+it w21
+it w38
+sort
+new
+ih w15
+ih w32
+ih w09
+ih w26
+ih w03
+ih w20
+ih w37
+ih w14
+ih w31
+ih w08
+ih w25
+ih w02
+ih w19
+ih w36
+ih w13
+sort
+new
+it w30
+it w07
+it w24
+it w01
+it w18
+it w35
+it w12
+it w29
+it w06
+it w23
+ih m 14
+sort
+merge
+size
+dm
+swap
+reverse
+rh w39
+rt m
+rh w37
+rt m
+rh w38
+rt m
+rh w35
+rt m
+rh w36
+rt m
+rh w33
+rt m
+rh w34
+rt m
+rh w31
+rt m
+rh w32
+rt m
+rh w29
+rt m
+rh w30
+rt m
+rh w27
+rt m
+rh w28
+rt m
+rh w25
+rt m
+rh w26
+rt w01
+rh w23
+rt w00
+rh w24
+rt w03
+rh w21
+rt w02
+rh w22
+rt w05
+rh w19
+rt w04
+rh w20
+rt w07
+rh w17
+rt w06
+rh w18
+rt w09
+rh w15
+rt w08
+rh w16
+rt w11
+rh w12
+rt w10
+rh w14
+free
@@ -0,0 +1,344 @@
+# Test of delete at position, split and the order-statistic index
+option fail 0
+option malloc 0
+new
+ih p00
+it p23
+it p46
+ih p19
+it p42
+it p15
+ih p38
+it p11
+it p34
+ih p07
+it p30
+it p03
+ih p26
+it p49
+it p22
+ih p45
+it p18
+it p41
+ih p14
+it p37
+it p10
+ih p33
+it p06
+it p29
+ih p02
+it p25
+it p48
+ih p21
+it p44
+it p17
+ih p40
+it p13
+it p36
+ih p09
+it p32
+it p05
+ih p28
+it p01
+it p24
+ih p47
+it p20
+it p43
+ih p16
+it p39
+it p12
+ih p35
+it p08
+it p31
+ih p04
+it p27
+dk 0
+dk 48
+dk 17
+dk 60
+dk -1
+size
+dm
+dk 5
+dk 30
+rh p35
+rt p31
+size
+split 20
+size
+dk 0
+dk 18
+rt p34
+next
+size
+dk 3
+rh p03
+rt p08
+dk 17
+size
+split 100
+size
+next
+size
+dk 0
+free
+rh p47
+rt p11
+rh p28
+rt p15
+rh p09
+rt p42
+rh p21
+rt p23
+rh p02
+rt p00
+rh p33
+rt p19
+rh p14
+rt p38
+rh p45
+rt p07
+rh p26
+free
+split 0
+size
+free
+size
+sort
+split 9
+size
+next
+reverse
+sort
+size
+merge
+size
+dk 7
+dm
+dk 15
+rh p01
+rt p43
+rh p05
+rt p37
+rh p06
+rt p36
+rh p10
+rt p32
+rh p12
+rt p29
+rh p13
+rt p25
+rh p17
+rt p24
+rh p20
+free
+option index 1
+new
+ih p00
+it p23
+it p46
+ih p19
+it p42
+it p15
+ih p38
+it p11
+it p34
+ih p07
+it p30
+it p03
+ih p26
+it p49
+it p22
+ih p45
+it p18
+it p41
+ih p14
+it p37
+it p10
+ih p33
+it p06
+it p29
+ih p02
+it p25
+it p48
+ih p21
+it p44
+it p17
+ih p40
+it p13
+it p36
+ih p09
+it p32
+it p05
+ih p28
+it p01
+it p24
+ih p47
+it p20
+it p43
+ih p16
+it p39
+it p12
+ih p35
+it p08
+it p31
+ih p04
+it p27
+dk 0
+dk 48
+dk 17
+dk 60
+dk -1
+size
+dm
+dk 5
+dk 30
+rh p35
+rt p31
+size
+split 20
+size
+dk 0
+dk 18
+rt p34
+next
+size
+dk 3
+rh p03
+rt p08
+dk 17
+size
+split 100
+size
+next
+size
+dk 0
+free
+rh p47
+rt p11
+rh p28
+rt p15
+rh p09
+rt p42
+rh p21
+rt p23
+rh p02
+rt p00
+rh p33
+rt p19
+rh p14
+rt p38
+rh p45
+rt p07
+rh p26
+free
+split 0
+size
+free
+size
+sort
+split 9
+size
+next
+reverse
+sort
+size
+merge
+size
+dk 7
+dm
+dk 15
+rh p01
+rt p43
+rh p05
+rt p37
+rh p06
+rt p36
+rh p10
+rt p32
+rh p12
+rt p29
+rh p13
+rt p25
+rh p17
+rt p24
+rh p20
+free
+new
+it a 30
+it b 30
+it c 30
+dk 29
+dk 29
+dk 58
+size
+split 29
+size
+next
+size
+rh b
+rh b
+rh b
+dk 27
+split 26
+size
+next
+rh c
+free
+rh a
+rt a
+rh a
+rt a
+rh a
+rt a
+rh a
+rt a
+rh a
+rt a
+rh a
+rt a
+rh a
+rt a
+rh a
+rt a
+rh a
+rt a
+rh a
+rt a
+rh a
+rt a
+rh a
+rt a
+rh a
+rt a
+rh a
+rt a
+rh a
+free
+rh b
+rt b
+rh b
+rt b
+rh b
+rt b
+rh b
+rt b
+rh b
+rt b
+rh b
+rt b
+rh b
+rt b
+rh b
+rt b
+rh b
+rt b
+rh b
+rt b
+rh b
+rt b
+rh b
+rt b
+rh b
+rt b
+free
@@ -0,0 +1,159 @@
+# Test of removing several elements at once from either end
+option fail 0
+option malloc 0
+new
+ih r00
+it r29
+ih r58
+it r27
+ih r56
+it r25
+ih r54
+it r23
+ih r52
+it r21
+ih r50
+it r19
+ih r48
+it r17
+ih r46
+it r15
+ih r44
+it r13
+ih r42
+it r11
+ih r40
+it r09
+ih r38
+it r07
+ih r36
+it r05
+ih r34
+it r03
+ih r32
+it r01
+ih r30
+it r59
+ih r28
+it r57
+ih r26
+it r55
+ih r24
+it r53
+ih r22
+it r51
+ih r20
+it r49
+ih r18
+it r47
+ih r16
+it r45
+ih r14
+it r43
+ih r12
+it r41
+ih r10
+it r39
+ih r08
+it r37
+ih r06
+it r35
+ih r04
+it r33
+ih r02
+it r31
+rhn 1
+rh r04
+rtn 1
+rt r33
+size
+rhn 7
+rh r20
+rt r35
+rtn 9
+rt r55
+rh r22
+size
+reverse
+rhn 5
+rt r24
+rtn 3
+rh r07
+size
+sort
+rhn 10
+rh r27
+rtn 10
+rt r38
+size
+rhn 4
+size
+rhn 3
+rtn 2
+size
+ih x 40
+it y 20
+rtn 19
+rt y
+rhn 38
+rh x
+rh x
+size
+free
+new
+it b 5
+ih a 5
+it c 5
+rtn 100
+size
+it m
+ih l
+it n
+rhn 2
+rh n
+size
+it r00
+ih r29
+ih r58
+it r27
+ih r56
+ih r25
+it r54
+ih r23
+ih r52
+it r21
+ih r50
+ih r19
+it r48
+ih r17
+ih r46
+it r15
+ih r44
+ih r13
+it r42
+ih r11
+ih r40
+it r09
+ih r38
+ih r07
+it r36
+swap
+rtn 4
+rt r15
+reverseK 3
+rhn 6
+rh r50
+dm
+rtn 2
+size
+rh r46
+rt r58
+rh r17
+rt r27
+rh r52
+rt r00
+rh r23
+rt r56
+rh r19
+rt r29
+free
@@ -0,0 +1,314 @@
+# Test of queues allocating from per-queue arenas, including splits and
+# merges that leave several queues sharing one arena
+option fail 0
+option malloc 0
+option arena 1
+new
+ih a00
+it a31
+ih a62
+it a29
+ih a60
+it a27
+ih a58
+it a25
+ih a56
+it a23
+ih a54
+it a21
+ih a52
+it a19
+ih a50
+it a17
+ih a48
+it a15
+ih a46
+it a13
+ih a44
+it a11
+ih a42
+it a09
+ih a40
+it a07
+ih a38
+it a05
+ih a36
+it a03
+ih a34
+it a01
+ih a32
+it a63
+ih a30
+it a61
+ih a28
+it a59
+ih a26
+it a57
+rh a26
+rt a57
+dk 11
+size
+split 15
+size
+next
+size
+it a24
+it a55
+it a22
+it a53
+it a20
+it a51
+it a18
+it a49
+ih b 3
+rh b
+rt a49
+rhn 4
+rh a00
+size
+next
+it c 5
+ih a16
+dm
+rt c
+size
+sort
+next
+sort
+merge
+size
+rhn 10
+rh a18
+rtn 10
+rt a54
+dedup
+size
+rh a19
+rt a53
+rh a20
+rt a52
+rh a21
+rt a51
+rh a22
+rt a48
+rh a23
+rt a44
+rh a24
+rt a42
+rh a25
+rt a40
+rh a27
+rt a38
+rh a28
+rt a36
+rh a29
+rt a34
+rh a30
+rt a32
+rh a31
+free
+option arena 0
+new
+ih a00
+ih a31
+ih a62
+ih a29
+ih a60
+ih a27
+ih a58
+ih a25
+ih a56
+ih a23
+ih a54
+ih a21
+ih a52
+ih a19
+ih a50
+ih a17
+ih a48
+ih a15
+ih a46
+ih a13
+option arena 1
+new
+it a44
+it a11
+it a42
+it a09
+it a40
+it a07
+it a38
+it a05
+it a36
+it a03
+it a34
+it a01
+it a32
+it a63
+it a30
+it a61
+it a28
+it a59
+it a26
+it a57
+it a24
+it a55
+it a22
+it a53
+ih d 4
+sort
+next
+sort
+merge
+size
+ih a20
+ih a51
+ih a18
+ih a49
+ih a16
+ih a47
+ih a14
+ih a45
+rh a45
+rt d
+reverse
+rtn 5
+rt a51
+size
+sort
+split 20
+size
+next
+rh a29
+it e
+rt e
+size
+rh a30
+rt d
+rh a31
+rt d
+rh a32
+rt d
+rh a34
+rt a63
+rh a36
+rt a62
+rh a38
+rt a61
+rh a40
+rt a60
+rh a42
+rt a59
+rh a44
+rt a58
+rh a46
+rt a57
+rh a48
+rt a56
+rh a50
+rt a55
+rh a52
+rt a54
+rh a53
+free
+rh a00
+rt a28
+rh a01
+rt a27
+rh a03
+rt a26
+rh a05
+rt a25
+rh a07
+rt a24
+rh a09
+rt a23
+rh a11
+rt a22
+rh a13
+rt a21
+rh a15
+rt a20
+rh a17
+rt a19
+free
+new
+it a00
+it a31
+it a62
+it a29
+it a60
+it a27
+it a58
+it a25
+it a56
+it a23
+it a54
+it a21
+it a52
+it a19
+it a50
+it a17
+it a48
+it a15
+it a46
+it a13
+it a44
+it a11
+it a42
+it a09
+it a40
+it a07
+it a38
+it a05
+it a36
+it a03
+split 10
+next
+split 5
+size
+next
+size
+it f 3
+rh a17
+sort
+next
+ih g 2
+sort
+size
+next
+rt a50
+rh a54
+size
+free
+size
+sort
+next
+sort
+merge
+size
+rhn 7
+rh a15
+rt g
+dk 4
+size
+rh a23
+rt g
+rh a25
+rt f
+rh a27
+rt f
+rh a29
+rt f
+rh a36
+rt a62
+rh a38
+rt a60
+rh a40
+rt a58
+rh a42
+rt a56
+rh a44
+rt a48
+rh a46
+free
@@ -0,0 +1,14 @@
+# Test of the lock-free queue shared by producer and consumer threads, from a
+# single pair up to more threads than slots, with every element delivered once
+# and in the order of its producer
+option fail 0
+option malloc 0
+mpmc 1 1 1000
+mpmc 1 1 5000 1
+mpmc 4 1 5000 2
+mpmc 1 4 5000 3
+mpmc 4 4 20000 16
+mpmc 8 3 10000 64
+mpmc 3 3 10000 1
+mpmc 16 16 5000
+mpmc 2 8 50000 1024